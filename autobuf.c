@@ -0,0 +1,250 @@
+/*
+ * autobuf.c - pick the socket buffer size from the bandwidth-delay
+ *	       product (-W)
+ *
+ * A short probe stream reads the path's RTT from TCP_INFO before the
+ * queues have filled, then -j streams left to the kernel's own buffer
+ * autotuning (no -b) show the rate the path gives.  Rate per stream
+ * times RTT is the bandwidth-delay product, the data that must be in
+ * flight to keep the path busy, and so what the send buffer has to
+ * hold.  A size worked out from it is run against the same receiver
+ * (started with -k 0) and compared with autotuning; "search" also runs
+ * 1/4 to 4 times that size and settles on the smallest one within 5%
+ * of the best.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/types.h>
+#include "streams.h"
+#include "units.h"
+#include "autobuf.h"
+
+extern int buflen;
+extern int nbuf;
+extern int sockbufsize;
+extern int nthreads;
+
+char *outfmt(double b);
+
+#define MAXSTREAMS 256
+#define PROBEBYTES (256*1024)	/* sent by the RTT probe */
+#define HEADROOM   2		/* sockbufsize = HEADROOM x BDP */
+#define ROUND      4096		/*  rounded up to this */
+#define MAXSOCKBUF (INT_MAX / 4 / ROUND * ROUND) /* so search's 4x fits an int */
+#define PLATEAU    0.95		/* search: within 5% of the best will do */
+#define NTRY       5		/* search: 1/4, 1/2, 1, 2 and 4 times it */
+
+static int search;		/* -W search */
+
+struct point {
+    int sockbuf;		/* -b, 0 for kernel autotuning */
+    double tput;		/* bytes/sec, all streams together */
+    double cpugb;		/* cpu-sec/GB */
+    unsigned rtt;		/* mean of the streams' smoothed RTTs */
+    unsigned retrans;		/* total */
+    int sndbuf;			/* largest SO_SNDBUF at the end */
+};
+
+
+void
+autobufopt(
+    char *spec)
+{
+    if (strcmp(spec, "bdp") == 0)
+	search = 0;
+    else if (strcmp(spec, "search") == 0)
+	search = 1;
+    else {
+	fprintf(stderr, "ttcp: bad -W %s, expected bdp or search\n", spec);
+	exit(1);
+    }
+}
+
+
+/* an int from /proc/sys, 0 if it can't be had */
+static int
+sysctlint(
+    char *path)
+{
+    FILE *f;
+    int val = 0;
+
+    if ((f = fopen(path, "r")) == NULL)
+	return(0);
+    if (fscanf(f, "%d", &val) != 1)
+	val = 0;
+    fclose(f);
+    return(val);
+}
+
+
+/* run n streams with the given -b */
+static void
+autorun(
+    struct point *pp,
+    int n,
+    int sb)
+{
+    struct stream streams[MAXSTREAMS];
+    unsigned long bytes = 0;
+    double longest = 0.0, cpu = 0.0, rtt = 0.0;
+    int ok = 0;
+    int s;
+
+    sockbufsize = sb;
+    for (s=0; s < n; ++s)
+	stream_start(&streams[s]);
+    for (s=0; s < n; ++s)
+	(void)stream_reap(streams, n);
+
+    memset(pp, 0, sizeof(*pp));
+    pp->sockbuf = sb;
+    for (s=0; s < n; ++s) {
+	if (!streams[s].ok)
+	    continue;
+	bytes += streams[s].bytes;
+	cpu += streams[s].cpu;
+	rtt += streams[s].rtt;
+	pp->retrans += streams[s].retrans;
+	if (streams[s].realt > longest)
+	    longest = streams[s].realt;
+	if (streams[s].sndbuf > pp->sndbuf)
+	    pp->sndbuf = streams[s].sndbuf;
+	++ok;
+    }
+    pp->tput = longest > 0.0 ? bytes / longest : 0.0;
+    pp->cpugb = bytes ? cpu * GIGABYTE / bytes : 0.0;
+    pp->rtt = ok ? rtt / ok : 0;
+}
+
+
+static void
+autoline(
+    struct point *pp,
+    struct point *pbase)
+{
+    char label[16];
+
+    if (pp->sockbuf)
+	snprintf(label, sizeof(label), "%d", pp->sockbuf);
+    else
+	snprintf(label, sizeof(label), "kernel");
+    fprintf(stdout, "ttcp-t:   %8s %8d %13s/sec %8.2f %8u %8u %+7.1f%%\n",
+	    label, pp->sndbuf, outfmt(pp->tput), pp->cpugb, pp->rtt,
+	    pp->retrans,
+	    pbase->tput > 0.0 ? 100.0 * (pp->tput - pbase->tput) / pbase->tput
+			      : 0.0);
+    fflush(stdout);
+}
+
+
+void
+autobuf(void)
+{
+    struct point probe, base, tries[NTRY];
+    struct point *pbest, *pchoice;
+    double rate, bdp;
+    int wmax = sysctlint("/proc/sys/net/core/wmem_max");
+    int streams = nthreads;
+    int bufs = nbuf;
+    int probebufs = PROBEBYTES / buflen > 4 ? PROBEBYTES / buflen : 4;
+    int chosen, sb;
+    int ntries = 0;
+    int i;
+
+    if (streams < 1 || streams > MAXSTREAMS) {
+	fprintf(stderr, "ttcp-t: -W runs 1..%d streams (-j)\n", MAXSTREAMS);
+	exit(1);
+    }
+
+    /* RTT from one short stream, before anything has queued up */
+    nbuf = probebufs;
+    autorun(&probe, 1, 0);
+    nbuf = bufs;
+    if (probe.rtt == 0) {
+	fprintf(stderr, "ttcp-t: -W: the probe got no RTT from TCP_INFO\n");
+	exit(1);
+    }
+    fprintf(stdout, "ttcp-t: autotune: probe of %d bytes, rtt %u usecs\n",
+	    probebufs * buflen, probe.rtt);
+
+    /* what the kernel manages by itself */
+    autorun(&base, streams, 0);
+    if (base.tput <= 0.0) {
+	fprintf(stderr, "ttcp-t: -W: the autotuned streams moved nothing\n");
+	exit(1);
+    }
+    rate = base.tput / streams;
+    bdp = rate * probe.rtt / 1e6;
+    fprintf(stdout, "ttcp-t: autotune: kernel autotuning: %s/sec over %d stream%s\n",
+	    outfmt(base.tput), streams, streams == 1 ? "" : "s");
+    fprintf(stdout, "ttcp-t: autotune: BDP = %s/sec per stream x %u usecs = %.0f bytes\n",
+	    outfmt(rate), probe.rtt, bdp);
+
+    /*
+     * The send buffer holds what's in flight until it's acked, and
+     * should have as much again queued behind it for when the acks
+     * come in.  The kernel doubles whatever is asked for, to cover
+     * its per-packet overhead, so the request itself is payload.
+     */
+    if (bdp * HEADROOM >= MAXSOCKBUF)
+	chosen = MAXSOCKBUF;
+    else
+	chosen = ((int)(bdp * HEADROOM) + ROUND - 1) / ROUND * ROUND;
+    if (chosen < ROUND)
+	chosen = ROUND;
+    fprintf(stdout, "ttcp-t: autotune: sockbufsize = %d x BDP, rounded up to %d: %d\n",
+	    HEADROOM, ROUND, chosen);
+    if (chosen == MAXSOCKBUF)
+	fprintf(stdout, "ttcp-t: autotune: capped at %d, the most -b takes here\n",
+		MAXSOCKBUF);
+    if (wmax > 0 && chosen > wmax)
+	fprintf(stdout, "ttcp-t: autotune: the kernel will cap it at net.core.wmem_max, %d\n",
+		wmax);
+
+    fprintf(stdout, "ttcp-t:   %8s %8s %18s %8s %8s %8s %8s\n",
+	    "sockbuf", "sndbuf", "throughput", "cpu/GB", "rtt", "retrans",
+	    "vs kernel");
+    autoline(&base, &base);
+    if (search) {
+	for (i=0; i < NTRY; ++i) {
+	    sb = (int)((double)chosen * (1 << i) / 4);
+	    sb = (sb + ROUND - 1) / ROUND * ROUND;
+	    if (ntries && sb == tries[ntries-1].sockbuf)
+		continue;
+	    autorun(&tries[ntries], streams, sb);
+	    autoline(&tries[ntries], &base);
+	    ++ntries;
+	}
+    } else {
+	autorun(&tries[0], streams, chosen);
+	autoline(&tries[0], &base);
+	ntries = 1;
+    }
+
+    /* the smallest that does about as well as any */
+    pbest = &tries[0];
+    for (i=1; i < ntries; ++i)
+	if (tries[i].tput > pbest->tput)
+	    pbest = &tries[i];
+    for (i=0; i < ntries; ++i)
+	if (tries[i].tput >= PLATEAU * pbest->tput)
+	    break;
+    pchoice = &tries[i];
+    if (search && pchoice->sockbuf != chosen)
+	fprintf(stdout, "ttcp-t: autotune: %d is the smallest within %.0f%% of the best (%d)\n",
+		pchoice->sockbuf, PLATEAU * 100, pbest->sockbuf);
+
+    fprintf(stdout, "ttcp-t: autotune: sockbufsize=%d: %s/sec, %+.1f%% on kernel autotuning\n",
+	    pchoice->sockbuf, outfmt(pchoice->tput),
+	    100.0 * (pchoice->tput - base.tput) / base.tput);
+    fprintf(stdout, "ttcp-t: autotune: send buffer per stream %d bytes, autotuning grew it to %d\n",
+	    pchoice->sndbuf, base.sndbuf);
+    fprintf(stdout, "ttcp-t: autotune: use -b %d at both ends\n",
+	    pchoice->sockbuf);
+    sockbufsize = pchoice->sockbuf;
+}
@@ -0,0 +1,2 @@
+void autobufopt(char *spec);
+void autobuf(void);
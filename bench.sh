@@ -0,0 +1,135 @@
+#!/bin/sh
+#
+# bench.sh - loopback benchmark matrix (make bench)
+#
+# Runs a receiver and a transmitter over 127.0.0.1 for each point of a
+# fixed matrix: TCP with -s and from stdin to stdout, with and without
+# -D, at several -l; UDP with -s.  Each point is run -R times and its
+# runs are saved (-o) in DIR/last/POINT, then compared (-c) with
+# DIR/baseline/POINT if there is one, or else with the previous
+# bench's.  DIR/last/summary gets a line per point:
+#
+#	point  Mbit/s  cpu-sec/GB  verdict
+#
+# TCP is measured at the transmitter, UDP at the receiver (what got
+# through).  The exit status is 2 if any point regressed.
+#
+# usage: bench.sh [-b] [-R runs] [-p port] [-d dir] [-t ttcp]
+#	-b	make this bench the baseline afterwards
+#
+
+TTCP=./ttcp
+DIR=bench
+RUNS=5
+PORT=5100
+SAVE=0
+
+while getopts bR:p:d:t: c; do
+	case $c in
+	b)	SAVE=1 ;;
+	R)	RUNS=$OPTARG ;;
+	p)	PORT=$OPTARG ;;
+	d)	DIR=$OPTARG ;;
+	t)	TTCP=$OPTARG ;;
+	*)	echo "usage: $0 [-b] [-R runs] [-p port] [-d dir] [-t ttcp]" >&2
+		exit 1 ;;
+	esac
+done
+
+if [ "$RUNS" -lt 2 ]; then
+	echo "$0: -R must be at least 2 to compare" >&2
+	exit 1
+fi
+TO=
+command -v timeout >/dev/null 2>&1 && TO="timeout 300"
+
+mkdir -p "$DIR" || exit 1
+rm -rf "$DIR/prev"
+[ -d "$DIR/last" ] && mv "$DIR/last" "$DIR/prev"
+mkdir "$DIR/last" || exit 1
+if [ -d "$DIR/baseline" ]; then
+	BASE=$DIR/baseline
+else
+	BASE=$DIR/prev
+fi
+[ -f "$DIR/data" ] ||
+	dd if=/dev/zero of="$DIR/data" bs=1048576 count=64 2>/dev/null
+
+SUM=$DIR/last/summary
+echo "# ttcp loopback bench, $RUNS runs per point, `date`" > "$SUM"
+echo "# `uname -srm`" >> "$SUM"
+echo "# point	Mbit/s	cpu-sec/GB	verdict" >> "$SUM"
+STATUS=0
+
+# point NAME PROTO SINK LEN NODELAY
+point() {
+	name=$1 opts="-l $4"
+	[ "$2" = udp ] && opts="$opts -u"
+	PORT=`expr $PORT + 1`
+
+	cmp=
+	[ -f "$BASE/$1" ] && cmp="-c $BASE/$1"
+	if [ "$2" = udp ]; then
+		rside="-o $DIR/last/$1 $cmp" tside=
+	else
+		rside= tside="-o $DIR/last/$1 $cmp"
+	fi
+
+	if [ "$3" = s ]; then
+		# the same bytes at every -l: 128MB for TCP, 32MB for UDP
+		if [ "$2" = udp ]; then n=`expr 33554432 / $4`
+		else n=`expr 134217728 / $4`; fi
+		$TO $TTCP -r -s $opts -R $RUNS -p $PORT $rside \
+		    > "$DIR/last/$1.r" 2>&1 &
+		rpid=$!
+		sleep 1
+		$TO $TTCP -t -s $opts $5 -n $n -R $RUNS -p $PORT $tside \
+		    127.0.0.1 > "$DIR/last/$1.t" 2>&1
+		tstat=$?
+	else
+		$TO $TTCP -r $opts -R $RUNS -p $PORT $rside \
+		    > /dev/null 2> "$DIR/last/$1.r" &
+		rpid=$!
+		sleep 1
+		$TO $TTCP -t $opts $5 -R $RUNS -p $PORT $tside 127.0.0.1 \
+		    < "$DIR/data" > "$DIR/last/$1.t" 2>&1
+		tstat=$?
+	fi
+	wait $rpid
+	rstat=$?
+
+	if [ "$2" = udp ]; then st=$rstat; else st=$tstat; fi
+	case $st in
+	0)	if [ -n "$cmp" ]; then verdict=ok; else verdict=new; fi ;;
+	2)	verdict=REGRESSION STATUS=2 ;;
+	*)	verdict=FAILED STATUS=2 ;;
+	esac
+	if [ -f "$DIR/last/$1" ]; then
+		awk -v name="$1" -v verdict="$verdict" '
+		    /^#/ { next }
+		    { t += $1; c += $2; n++ }
+		    END { printf("%s\t%.1f\t%.3f\t%s\n", name,
+			  n ? t / n * 8 / 1e6 : 0, n ? c / n : 0, verdict) }' \
+		    "$DIR/last/$1" >> "$SUM"
+	else
+		printf "%s\t-\t-\t%s\n" "$1" "$verdict" >> "$SUM"
+	fi
+}
+
+for l in 1024 8192 65536; do
+	point tcp-s-l$l tcp s $l ""
+	point tcp-s-l$l-D tcp s $l -D
+	point tcp-io-l$l tcp io $l ""
+	point tcp-io-l$l-D tcp io $l -D
+done
+for l in 1024 8192 32768; do
+	point udp-s-l$l udp s $l ""
+done
+
+cat "$SUM"
+if [ $SAVE = 1 ]; then
+	rm -rf "$DIR/baseline"
+	cp -r "$DIR/last" "$DIR/baseline"
+	echo "saved as $DIR/baseline"
+fi
+exit $STATUS
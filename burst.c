@@ -0,0 +1,347 @@
+/*
+ * burst.c - on/off traffic (-a)
+ *
+ * Instead of writing back to back, the transmitter sends a burst of
+ * SIZE bytes every INTERVAL msecs, spreading each burst over DUTY
+ * percent of the interval (100, the default, is as fast as it'll
+ * go).  Burst starts are scheduled from CLOCK_MONOTONIC at absolute
+ * times, so a late burst doesn't push the rest back, and are
+ * synchronized to whole intervals since the epoch of that clock, so
+ * several transmitters with the same -a fire together.  For TCP the
+ * transmitter also waits for each burst's send queue to drain.
+ *
+ * The receiver, given the same -a, cuts the TCP stream into bursts
+ * by byte count; UDP datagrams carry their burst number in the first
+ * four bytes.  For each burst it notes when the first and last bytes
+ * arrived.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <arpa/inet.h>
+#ifdef __linux__
+#include <linux/sockios.h>
+#endif
+#include "samples.h"
+#include "burst.h"
+
+extern int trans;
+extern int udp;
+extern int buflen;
+extern char *buf;
+extern unsigned long nbytes;
+extern int progress;
+extern int speed;
+
+void sys_err(char *s);
+int Nwrite(int fd, void *buf, int count);
+char *outfmt(double b);
+void drawtick(int len, int nbytes);
+void dospeed(int nbytes);
+
+#define SPIN_NS 50000		/* busy wait gaps shorter than this */
+
+static long size;		/* bytes per burst */
+static double interval;		/* nsecs from one burst to the next */
+static double duty = 100.0;	/* percent of the interval to spread over */
+
+static unsigned long bursts;
+static unsigned long late;	/* started after their slot was over */
+static unsigned long undrained;	/* TCP: still queued when the next was due */
+static struct samples written;	/* -t: start to last write, usecs */
+static struct samples drained;	/*  TCP: start to empty send queue */
+static struct samples spread;	/* -r: first to last arrival, usecs */
+static struct samples gaps;	/*  first arrival to next first */
+static double peak;		/* best burst, bytes/sec */
+
+/* -r: the burst coming in */
+static double first, last;	/* when its first and last bytes came */
+static long have;		/* bytes of it so far */
+static long dgrams;		/*  UDP datagrams */
+static uint32_t cur;		/*  and its number */
+static unsigned long lost;	/* UDP datagrams missing from bursts */
+static unsigned long worst;	/*  the most from one */
+
+
+static double
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+/* wait until CLOCK_MONOTONIC reads t, spinning for the last bit */
+static void
+waituntil(double t)
+{
+    struct timespec ts;
+    double left = t - now_ns();
+
+    if (left > SPIN_NS) {
+	t -= SPIN_NS;
+	ts.tv_sec = (time_t)(t / 1e9);
+	ts.tv_nsec = (long)(t - ts.tv_sec * 1e9);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+	    ;
+	t += SPIN_NS;
+    }
+    while (now_ns() < t)
+	;
+}
+
+
+void
+burstopt(
+    char *spec)
+{
+    char *end;
+
+    size = strtol(spec, &end, 10);
+    switch (*end) {
+    case 'k': case 'K':
+	size *= 1024;
+	++end;
+	break;
+    case 'm': case 'M':
+	size *= 1024 * 1024;
+	++end;
+	break;
+    case 'b':
+	size = -size;		/* in -l buffers, resolved later */
+	++end;
+	break;
+    }
+    if (size == 0 || *end != ',')
+	goto bad;
+    interval = strtod(end + 1, &end) * 1e6;
+    if (interval <= 0.0)
+	goto bad;
+    if (*end == ',') {
+	duty = strtod(end + 1, &end);
+	if (duty <= 0.0 || duty > 100.0)
+	    goto bad;
+    }
+    if (*end == '\0')
+	return;
+bad:
+    fprintf(stderr,
+	    "ttcp: bad -a %s, expected SIZE[k|m|b],MSECS[,DUTY%%]\n", spec);
+    exit(1);
+}
+
+
+/* before each run; -l is known by now */
+void
+burst_start(void)
+{
+    if (size < 0)
+	size = -size * buflen;
+    bursts = late = undrained = lost = worst = 0;
+    have = dgrams = 0;
+    peak = 0.0;
+    samples_free(&written);
+    samples_free(&drained);
+    samples_free(&spread);
+    samples_free(&gaps);
+}
+
+
+void
+burst_source(
+    int fd,
+    int n)
+{
+    double total = (double)n * buflen;
+    double start, now, pace;
+    unsigned long b;
+    long left, cnt, wlen;
+    int queued;
+
+    /* start on an interval boundary, so other senders line up with us */
+    start = (floor(now_ns() / interval) + 1) * interval;
+    pace = interval * duty / 100.0 / size;	/* nsecs per byte */
+
+    for (b = 0; total > 0; ++b) {
+	double t0 = start + b * interval;
+
+	if (now_ns() > t0 + interval) {
+	    ++late;
+	    t0 = now_ns();
+	}
+	waituntil(t0);
+	for (left = size; left > 0 && total > 0; left -= cnt, total -= cnt) {
+	    cnt = left < buflen ? left : buflen;
+	    if (cnt > total)
+		cnt = total;
+	    if (udp) {
+		uint32_t nb = htonl((uint32_t)b);
+		memcpy(buf, &nb, sizeof(nb));
+	    }
+	    if (duty < 100.0)
+		waituntil(t0 + (size - left) * pace);
+	    /* a UDP tail of 4 bytes or less would look like the end */
+	    wlen = udp && cnt < 5 ? 5 : cnt;
+	    if (Nwrite(fd, buf, wlen) != wlen)
+		return;
+	    /* -P ticks once per -l worth, as the plain loop does */
+	    if (progress)
+		drawtick((nbytes + wlen) / buflen - nbytes / buflen, wlen);
+	    else if (speed)
+		dospeed(wlen);
+	    nbytes += wlen;
+	}
+	now = now_ns();
+	samples_add(&written, (now - t0) / 1e3);
+	if (now > t0 && (size - left) / ((now - t0) / 1e9) > peak)
+	    peak = (size - left) / ((now - t0) / 1e9);
+	++bursts;
+
+#ifdef SIOCOUTQ
+	/* until it's all acked, or the next burst is due */
+	if (!udp) {
+	    queued = -1;
+	    while (ioctl(fd, SIOCOUTQ, &queued) == 0 && queued > 0 &&
+		   now_ns() < t0 + interval)
+		waituntil(now_ns() + 10000);
+	    if (queued == 0)
+		samples_add(&drained, (now_ns() - t0) / 1e3);
+	    else
+		++undrained;
+	}
+#endif
+    }
+}
+
+
+/* the burst coming in has fully arrived, or as much of it as will */
+static void
+burstdone(void)
+{
+    static double prevfirst;
+
+    samples_add(&spread, (last - first) / 1e3);
+    if (bursts)
+	samples_add(&gaps, (first - prevfirst) / 1e3);
+    prevfirst = first;
+    if (last > first && have / ((last - first) / 1e9) > peak)
+	peak = have / ((last - first) / 1e9);
+    ++bursts;
+    have = dgrams = 0;
+}
+
+
+/* UDP: a burst came in this many datagrams short */
+static void
+burstloss(long missing)
+{
+    if (missing > 0) {
+	lost += missing;
+	if (missing > (long)worst)
+	    worst = missing;
+    }
+}
+
+
+/*
+ * -r: cnt more bytes of data have arrived in rbuf; called with cnt 0
+ * at the end to finish the burst in progress
+ */
+void
+burst_recv(
+    char *rbuf,
+    int cnt)
+{
+    long want = (size + buflen - 1) / buflen;	/* UDP datagrams a burst */
+    double now = now_ns();
+    uint32_t nb;
+    long take;
+
+    if (cnt == 0) {
+	/* the last burst may be short, its loss can't be told */
+	if (have)
+	    burstdone();
+	return;
+    }
+
+    if (udp) {
+	memcpy(&nb, rbuf, sizeof(nb));
+	nb = ntohl(nb);
+	if (have && nb != cur) {
+	    burstloss(want - dgrams);
+	    burstdone();
+	    if (nb > cur + 1) {
+		/* whole bursts that never showed */
+		lost += (unsigned long)(nb - cur - 1) * want;
+		if (want > (long)worst)
+		    worst = want;
+	    }
+	}
+	if (have == 0) {
+	    cur = nb;
+	    first = now;
+	}
+	have += cnt;
+	++dgrams;
+	last = now;
+	return;
+    }
+
+    while (cnt > 0) {
+	if (have == 0)
+	    first = now;
+	take = size - have < cnt ? size - have : cnt;
+	have += take;
+	cnt -= take;
+	last = now;
+	if (have == size)
+	    burstdone();
+    }
+}
+
+
+void
+burst_report(void)
+{
+    char *side = trans ? "-t" : "-r";
+
+    fprintf(stdout,
+	    "ttcp%s: %lu bursts of %ld bytes every %.3f msecs, duty %.0f%%",
+	    side, bursts, size, interval / 1e6, duty);
+    if (trans)
+	fprintf(stdout, ", %lu late\n", late);
+    else
+	fprintf(stdout, "\n");
+    fprintf(stdout, "ttcp%s: burst peak rate %s/sec\n", side, outfmt(peak));
+    if (trans) {
+	fprintf(stdout, "ttcp-t: burst written usecs: %s\n",
+		samples_format(&written));
+	if (drained.n)
+	    fprintf(stdout, "ttcp-t: burst acked usecs: %s\n",
+		    samples_format(&drained));
+	if (undrained)
+	    fprintf(stdout,
+		    "ttcp-t: %lu bursts not all acked when the next was due\n",
+		    undrained);
+    } else {
+	fprintf(stdout, "ttcp-r: burst arrival spread usecs: %s\n",
+		samples_format(&spread));
+	if (gaps.n)
+	    fprintf(stdout,
+		    "ttcp-r: burst start gaps usecs: mean %.1f, sd %.1f\n",
+		    samples_mean(&gaps), samples_stddev(&gaps));
+	if (udp)
+	    fprintf(stdout,
+		    "ttcp-r: burst loss: %lu datagrams, at most %lu from one burst\n",
+		    lost, worst);
+    }
+}
@@ -0,0 +1,5 @@
+void burstopt(char *spec);
+void burst_start(void);
+void burst_source(int fd, int n);
+void burst_recv(char *rbuf, int cnt);
+void burst_report(void);
@@ -0,0 +1,77 @@
+/*
+ * cc.c - compare TCP congestion control algorithms (-Z alg,alg,...)
+ *
+ * Each algorithm gets its own sink-mode stream to the same receiver.
+ * -j sets how many of the streams run at once, so they can go back
+ * to back (the default) or all compete at the same time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include "streams.h"
+#include "units.h"
+#include "cc.h"
+
+extern int nthreads;
+extern char *ccname;
+
+void sys_err(char *s);
+char *outfmt(double b);
+
+#define MAXALGS 16
+
+
+void
+cccompare(
+    char *list)
+{
+    struct stream streams[MAXALGS];
+    char *algs[MAXALGS];
+    struct stream *ps;
+    char *alg;
+    int nalgs = 0;
+    int running = 0;
+    int i;
+
+    list = strdup(list);
+    for (alg = strtok(list, ","); alg; alg = strtok(NULL, ",")) {
+	if (nalgs == MAXALGS) {
+	    fprintf(stderr, "ttcp-t: at most %d algorithms\n", MAXALGS);
+	    exit(1);
+	}
+	algs[nalgs++] = alg;
+    }
+
+    for (i=0; i < nalgs; ++i) {
+	if (running == nthreads) {
+	    (void)stream_reap(streams, i);
+	    --running;
+	}
+	ccname = algs[i];	/* inherited by the child */
+	stream_start(&streams[i]);
+	++running;
+    }
+    while (running-- > 0)
+	(void)stream_reap(streams, nalgs);
+
+    fprintf(stdout, "ttcp-t: %d streams, %d at a time\n",
+	    nalgs, nthreads < nalgs ? nthreads : nalgs);
+    fprintf(stdout, "ttcp-t: %-10s %18s %8s %9s %9s %8s %8s\n",
+	    "algorithm", "throughput", "retrans", "rtt(us)", "rttvar",
+	    "cpu(s)", "cpu/GB");
+    for (i=0; i < nalgs; ++i) {
+	ps = &streams[i];
+	if (!ps->ok) {
+	    fprintf(stdout, "ttcp-t: %-10s failed\n", algs[i]);
+	    continue;
+	}
+	fprintf(stdout, "ttcp-t: %-10s %13s/sec %8u %9u %9u %8.2f %8.2f\n",
+		algs[i], outfmt(ps->bytes / ps->realt),
+		ps->retrans, ps->rtt, ps->rttvar, ps->cpu,
+		ps->bytes ? ps->cpu * GIGABYTE / ps->bytes : 0.0);
+    }
+    free(list);
+}
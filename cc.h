@@ -0,0 +1 @@
+void cccompare(char *list);
@@ -0,0 +1,296 @@
+/*
+ * connrate.c - connection rate benchmark (-C)
+ *
+ * The transmitter opens, optionally writes a small payload to, and
+ * closes one connection after another from several threads.  The
+ * receiver accepts them from several threads and drains each to EOF.
+ * Connections/sec and connect() latency are what get reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "samples.h"
+#include "connrate.h"
+
+extern int trans;
+extern int domain;
+extern int verbose;
+extern int nodelay;
+extern int sockbufsize;
+extern int one;
+extern char *host;
+extern struct sockaddr *peer;
+extern socklen_t peerlen;
+extern struct sockaddr_in sinme;
+extern struct sockaddr_un sunme;
+extern socklen_t sunlen;
+extern double cput, realt;
+
+extern int conns;		/* connections to make or accept */
+extern int connpayload;		/* bytes written on each one */
+extern int nthreads;		/* worker threads */
+
+void sys_err(char *s);
+void mes(char *s);
+void prep_timer(void);
+double read_timer(char *str, int len);
+int setlinger(int fd);
+char *outfmt(double b);
+
+#define IDLEMS 5000		/* receiver gives up after this long idle */
+
+static int lfd = -1;		/* receiver's listening socket */
+static volatile int ndone;	/* connections handed out so far */
+static volatile int nfailed;	/* connects that failed */
+static volatile unsigned long cbytes; /* payload bytes moved */
+static double tfirst, tlast;	/* receiver: first accept, last close */
+static int nactive;		/* receiver: connections being drained */
+static int gaveup;		/*  stopped waiting for the rest */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct worker {
+    pthread_t tid;
+    struct samples lat;		/* connect() latency, usecs */
+};
+
+
+static double
+now_usecs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec * 1e6 + ts.tv_nsec / 1e3);
+}
+
+
+/* claim the next connection number, -1 when all are taken */
+static int
+nextconn(void)
+{
+    int n;
+
+    pthread_mutex_lock(&lock);
+    n = (ndone < conns) ? ndone++ : -1;
+    pthread_mutex_unlock(&lock);
+
+    return(n);
+}
+
+
+static void *
+connector(
+    void *arg)
+{
+    struct worker *pw = arg;
+    char *payload = NULL;
+    double t0;
+    int fd;
+    int cnt;
+    int left;
+
+    if (connpayload && (payload = calloc(1, connpayload)) == NULL)
+	sys_err("malloc");
+
+    while (nextconn() >= 0) {
+	t0 = now_usecs();
+	if ((fd = socket(domain, SOCK_STREAM, 0)) < 0)
+	    sys_err("socket");
+	if (setlinger(fd) < 0)
+	    sys_err("setsockopt: linger");
+#ifdef TCP_NODELAY
+	if (nodelay && domain == AF_INET)
+	    (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+			     (char *)&one, sizeof(one));
+#endif
+	if (sockbufsize)
+	    (void)setsockopt(fd, SOL_SOCKET, SO_SNDBUF,
+			     (char *)&sockbufsize, sizeof(sockbufsize));
+	if (connect(fd, peer, peerlen) < 0) {
+	    if (verbose)
+		perror("ttcp-t: connect");
+	    __sync_fetch_and_add(&nfailed, 1);
+	    close(fd);
+	    continue;
+	}
+	samples_add(&pw->lat, now_usecs() - t0);
+
+	for (left = connpayload; left > 0; left -= cnt) {
+	    if ((cnt = write(fd, payload, left)) <= 0)
+		break;
+	    __sync_fetch_and_add(&cbytes, cnt);
+	}
+	close(fd);
+    }
+
+    free(payload);
+    return(NULL);
+}
+
+
+static void *
+acceptor(
+    void *arg)
+{
+    char buf[16*1024];
+    struct pollfd pfd;
+    int fd;
+    int cnt;
+
+    while (1) {
+	pfd.fd = lfd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, IDLEMS) == 0) {
+	    /*
+	     * Nothing for a while after the first: connects that failed
+	     * at the other end will never show up, so stop waiting.
+	     */
+	    pthread_mutex_lock(&lock);
+	    if (tfirst != 0.0 && nactive == 0 &&
+		now_usecs() - tlast >= IDLEMS * 1e3) {
+		gaveup = 1;
+		shutdown(lfd, SHUT_RDWR);
+	    }
+	    pthread_mutex_unlock(&lock);
+	    continue;
+	}
+	if ((fd = accept(lfd, (struct sockaddr *)0, (socklen_t *)0)) < 0) {
+	    if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN)
+		continue;
+	    break;		/* listener shut down, we're done */
+	}
+	pthread_mutex_lock(&lock);
+	if (tfirst == 0.0)
+	    tfirst = now_usecs();
+	++nactive;
+	pthread_mutex_unlock(&lock);
+
+	while ((cnt = read(fd, buf, sizeof(buf))) > 0)
+	    __sync_fetch_and_add(&cbytes, cnt);
+	close(fd);
+
+	pthread_mutex_lock(&lock);
+	tlast = now_usecs();
+	--nactive;
+	if (++ndone == conns)
+	    shutdown(lfd, SHUT_RDWR);	/* wake up the other acceptors */
+	pthread_mutex_unlock(&lock);
+    }
+
+    return(NULL);
+}
+
+
+static void
+listensetup(void)
+{
+    if ((lfd = socket(domain, SOCK_STREAM, 0)) < 0)
+	sys_err("socket");
+    if (domain == AF_UNIX) {
+	if (sunme.sun_path[0] != '\0')
+	    (void)unlink(sunme.sun_path);
+	if (bind(lfd, (struct sockaddr *) &sunme, sunlen) < 0)
+	    sys_err("bind");
+    } else {
+	(void)setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR,
+			 (char *)&one, sizeof(one));
+	sinme.sin_family = AF_INET;
+	if (bind(lfd, (struct sockaddr *) &sinme, sizeof(sinme)) < 0)
+	    sys_err("bind");
+    }
+    if (sockbufsize)
+	(void)setsockopt(lfd, SOL_SOCKET, SO_RCVBUF,
+			 (char *)&sockbufsize, sizeof(sockbufsize));
+    if (listen(lfd, SOMAXCONN) < 0)
+	sys_err("listen");
+    /* the acceptors poll, so none is left stuck in accept() */
+    if (fcntl(lfd, F_SETFL, fcntl(lfd, F_GETFL) | O_NONBLOCK) < 0)
+	sys_err("fcntl");
+}
+
+
+void
+connrate(void)
+{
+    struct worker *workers;
+    struct samples lat;
+    char *side = trans ? "-t" : "-r";
+    char stats[128];
+    double elapsed;
+    int made;
+    int i;
+
+    fprintf(stdout, "ttcp%s: conns=%d, payload=%d, threads=%d",
+	    side, conns, connpayload, nthreads);
+    if (sockbufsize)
+	fprintf(stdout, ", sockbufsize=%d", sockbufsize);
+    fprintf(stdout, "  %s%s%s\n", domain == AF_UNIX ? "unix" : "tcp",
+	    trans ? "  -> " : "", trans ? host : "");
+
+    if ((workers = calloc(nthreads, sizeof(struct worker))) == NULL)
+	sys_err("malloc");
+
+    if (!trans)
+	listensetup();
+
+    prep_timer();
+    tfirst = trans ? now_usecs() : 0.0; /* else clock starts at first accept */
+    for (i=0; i < nthreads; ++i) {
+	samples_init(&workers[i].lat);
+	if (pthread_create(&workers[i].tid, NULL,
+			   trans ? connector : acceptor, &workers[i]) != 0)
+	    sys_err("pthread_create");
+    }
+    samples_init(&lat);
+    for (i=0; i < nthreads; ++i) {
+	pthread_join(workers[i].tid, NULL);
+	samples_merge(&lat, &workers[i].lat);
+	samples_free(&workers[i].lat);
+    }
+    if (trans)
+	tlast = now_usecs();
+    (void)read_timer(stats, sizeof(stats));
+    if (!trans && domain == AF_UNIX && sunme.sun_path[0] != '\0')
+	(void)unlink(sunme.sun_path);
+
+    made = trans ? lat.n : ndone;
+    elapsed = (tlast - tfirst) / 1e6;
+    if (elapsed <= 0.0)
+	elapsed = 0.001;
+    if (cput <= 0.0)
+	cput = 0.001;
+
+    fprintf(stdout,
+	    "ttcp%s: %d connections in %.2f real seconds = %.2f conn/sec +++\n",
+	    side, made, elapsed, made / elapsed);
+    if (trans) {
+	fprintf(stdout, "ttcp%s: %d connects failed\n", side, nfailed);
+	fprintf(stdout, "ttcp%s: connect usecs: %s\n",
+		side, samples_format(&lat));
+    } else if (gaveup) {
+	fprintf(stdout, "ttcp%s: %d connections never came, gave up after %d idle secs\n",
+		side, conns - ndone, IDLEMS / 1000);
+    }
+    if (connpayload || !trans)
+	fprintf(stdout, "ttcp%s: %lu payload bytes = %s/sec\n",
+		side, cbytes, outfmt(cbytes / elapsed));
+    if (verbose)
+	fprintf(stdout, "ttcp%s: %.2f CPU seconds = %.1f usec/conn\n",
+		side, cput, cput * 1e6 / (made ? made : 1));
+    fprintf(stdout, "ttcp%s: %s\n", side, stats);
+
+    samples_free(&lat);
+    free(workers);
+}
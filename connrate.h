@@ -0,0 +1 @@
+void connrate(void);
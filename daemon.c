@@ -0,0 +1,291 @@
+/*
+ * daemon.c - a receiver that stays up between tests (-G)
+ *
+ * "ttcp -r -G N" accepts connections forever, forking a child for
+ * each session like -k does, and remembers the results of the last N
+ * sessions.  A transmitter given "-G tag" starts the connection with a
+ * hello that carries its -l, -s and -T settings and a tag to file the
+ * result under, so one daemon can serve differently shaped tests back
+ * to back; one without a hello just gets the daemon's own settings.
+ * "ttcp -t -q host" asks for the history instead of sending data.
+ *
+ * The children send their results up a pipe shared by all of them;
+ * each record is one write() smaller than PIPE_BUF, so they don't mix.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "daemon.h"
+
+extern int fd;
+extern int trans;
+extern int domain;
+extern int buflen;
+extern char *buf;
+extern int bufalign;
+extern int bufoffset;
+extern int sinkmode;
+extern int touchdata;
+extern int daemonhist;		/* sessions to remember */
+extern int daemonquery;		/* -t: ask for the history */
+extern char *sessiontag;	/* -t: file the result under this */
+extern struct sockaddr_in frominet;
+extern unsigned long nbytes;
+extern unsigned long numCalls;
+extern double cput, realt;
+
+void sys_err(char *s);
+int Naccept(int lfd);
+char *outfmt(double b);
+
+#define HELLO_MAGIC	"ttcpsess"
+#define HELLO_QUERY	0x1	/* send the history back, no session */
+#define HELLO_SINK	0x2	/* -s */
+#define HELLO_TOUCH	0x4	/* -T */
+
+#define TAGLEN 48
+#define MAXBUFLEN (64*1024*1024)	/* the biggest -l a hello may ask for */
+
+struct hello {
+    char magic[8];
+    uint32_t flags;		/* network byte order */
+    uint32_t buflen;		/* network byte order */
+    char tag[TAGLEN];
+};
+
+struct result {
+    unsigned long id;
+    time_t start;
+    char peer[INET_ADDRSTRLEN];
+    char tag[TAGLEN];
+    int flags;
+    int buflen;
+    unsigned long bytes;
+    unsigned long calls;
+    double realt;
+    double cput;
+};
+
+static int resultfd = -1;	/* children write results here */
+static struct result cur;	/* this child's session */
+static struct result *hist;	/* the last daemonhist sessions */
+static unsigned long nsessions;
+
+
+/* wait a little while for a hello, without taking it if it isn't one */
+static int
+gethello(
+    int cfd,
+    struct hello *ph)
+{
+    struct timeval tv;
+    int n;
+
+    tv.tv_sec = 5;
+    tv.tv_usec = 0;
+    (void)setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    n = recv(cfd, ph, sizeof(*ph), MSG_PEEK | MSG_WAITALL);
+    tv.tv_sec = 0;
+    (void)setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    if (n != sizeof(*ph) || memcmp(ph->magic, HELLO_MAGIC, 8) != 0)
+	return(0);
+    (void)recv(cfd, ph, sizeof(*ph), MSG_WAITALL);
+    ph->flags = ntohl(ph->flags);
+    ph->buflen = ntohl(ph->buflen);
+    ph->tag[TAGLEN - 1] = '\0';
+    return(1);
+}
+
+
+static void
+sendhistory(
+    int cfd)
+{
+    FILE *f;
+    struct result *pr;
+    struct tm tm;
+    char when[32];
+    unsigned long i, first;
+
+    if ((f = fdopen(cfd, "w")) == NULL) {
+	close(cfd);
+	return;
+    }
+    first = nsessions > daemonhist ? nsessions - daemonhist : 0;
+    for (i = first; i < nsessions; ++i) {
+	pr = &hist[i % daemonhist];
+	localtime_r(&pr->start, &tm);
+	strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+	fprintf(f, "session %lu %s from %s tag=%s buflen=%d%s%s: ",
+		pr->id, when, pr->peer, pr->tag[0] ? pr->tag : "-",
+		pr->buflen,
+		(pr->flags & HELLO_SINK) ? " sink" : "",
+		(pr->flags & HELLO_TOUCH) ? " touch" : "");
+	fprintf(f, "%lu bytes in %.2f real seconds = %s/sec, ",
+		pr->bytes, pr->realt,
+		outfmt(pr->realt > 0.0 ? pr->bytes / pr->realt : 0.0));
+	fprintf(f, "%.2f CPU seconds, %lu I/O calls\n",
+		pr->cput, pr->calls);
+    }
+    fprintf(f, "%lu sessions, last %lu kept\n",
+	    nsessions, nsessions - first);
+    fclose(f);
+}
+
+
+/* the parent: never returns except in a child about to run a session */
+void
+daemon_serve(
+    int lfd)
+{
+    struct pollfd pfds[2];
+    struct hello h;
+    struct result r;
+    unsigned long id = 0;
+    int pfd[2];
+    int cfd;
+    pid_t pid;
+
+    if ((hist = calloc(daemonhist, sizeof(struct result))) == NULL)
+	sys_err("calloc");
+    if (pipe(pfd) < 0)
+	sys_err("pipe");
+    resultfd = pfd[1];
+
+    fflush(stdout);
+    while (1) {
+	pfds[0].fd = lfd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = pfd[0];
+	pfds[1].events = POLLIN;
+	if (poll(pfds, 2, -1) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    sys_err("poll");
+	}
+	while (waitpid(-1, (int *)0, WNOHANG) > 0)
+	    ;			/* reap the finished ones */
+
+	if (pfds[1].revents & POLLIN) {
+	    if (read(pfd[0], &r, sizeof(r)) == sizeof(r)) {
+		hist[nsessions % daemonhist] = r;
+		++nsessions;
+	    }
+	}
+	if (!(pfds[0].revents & POLLIN))
+	    continue;
+
+	cfd = Naccept(lfd);
+	memset(&cur, 0, sizeof(cur));
+	cur.id = ++id;
+	cur.start = time(NULL);
+	inet_ntop(AF_INET, &frominet.sin_addr, cur.peer, sizeof(cur.peer));
+
+	if ((pid = fork()) < 0)
+	    sys_err("fork");
+	if (pid == 0) {
+	    close(lfd);
+	    close(pfd[0]);
+	    /* a slow hello only holds up its own session */
+	    if (!gethello(cfd, &h)) {
+		memset(&h, 0, sizeof(h));
+		h.buflen = buflen;	/* an old ttcp, use our own settings */
+		h.flags = (sinkmode ? HELLO_SINK : 0) |
+		    (touchdata ? HELLO_TOUCH : 0);
+	    }
+	    if (h.flags & HELLO_QUERY) {
+		sendhistory(cfd);	/* as of the fork */
+		exit(0);
+	    }
+	    if (h.buflen < 1 || h.buflen > MAXBUFLEN) {
+		fprintf(stderr, "ttcp-r: session %lu: hello asks for buflen %u, not 1..%d\n",
+			cur.id, h.buflen, MAXBUFLEN);
+		exit(1);
+	    }
+	    memcpy(cur.tag, h.tag, TAGLEN);
+	    cur.flags = h.flags;
+	    cur.buflen = h.buflen;
+	    fd = cfd;
+	    /* take on the session's settings */
+	    sinkmode = (cur.flags & HELLO_SINK) != 0;
+	    touchdata = (cur.flags & HELLO_TOUCH) != 0;
+	    if (cur.buflen != buflen) {
+		buflen = cur.buflen;
+		if ((buf = malloc(buflen + bufalign)) == NULL)
+		    sys_err("malloc");
+		if (bufalign != 0)
+		    buf += (bufalign - ((unsigned long)buf % bufalign) +
+			    bufoffset) % bufalign;
+	    }
+	    fprintf(stdout, "ttcp-r: session %lu%s%s buflen=%d%s\n",
+		    cur.id, cur.tag[0] ? " tag=" : "", cur.tag, buflen,
+		    sinkmode ? " sink" : "");
+	    return;
+	}
+	close(cfd);
+    }
+}
+
+
+/* in the child, once the session has been reported */
+void
+daemon_result(void)
+{
+    if (resultfd < 0)
+	return;
+    cur.bytes = nbytes;
+    cur.calls = numCalls;
+    cur.realt = realt;
+    cur.cput = cput;
+    if (write(resultfd, &cur, sizeof(cur)) != sizeof(cur))
+	sys_err("write: result");
+}
+
+
+/* -t: introduce ourselves to a daemon */
+void
+daemon_hello(
+    int fd)
+{
+    struct hello h;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, HELLO_MAGIC, 8);
+    h.flags = htonl((daemonquery ? HELLO_QUERY : 0) |
+		    (sinkmode ? HELLO_SINK : 0) |
+		    (touchdata ? HELLO_TOUCH : 0));
+    h.buflen = htonl(buflen);
+    if (sessiontag)
+	snprintf(h.tag, TAGLEN, "%s", sessiontag);
+    if (write(fd, &h, sizeof(h)) != sizeof(h))
+	sys_err("write: hello");
+}
+
+
+/* -t -q: print the daemon's history */
+void
+daemon_query(
+    int fd)
+{
+    char qbuf[4096];
+    int n;
+
+    while ((n = read(fd, qbuf, sizeof(qbuf))) > 0)
+	if (fwrite(qbuf, 1, n, stdout) != n)
+	    break;
+    if (n < 0)
+	sys_err("read");
+}
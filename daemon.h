@@ -0,0 +1,4 @@
+void daemon_serve(int lfd);
+void daemon_hello(int fd);
+void daemon_result(void);
+void daemon_query(int fd);
@@ -0,0 +1,163 @@
+/*
+ * ktls.c - encrypt the stream with kernel TLS (-e)
+ *
+ * There's no handshake: both ends install the same made up key, IV,
+ * salt and starting record number on the data socket as soon as it's
+ * connected, the transmitter as TLS_TX and the receiver as TLS_RX,
+ * and from then on plain read()s and write()s (and sendfile() with
+ * -F) move TLS 1.2 records.  It's only for measuring what the crypto
+ * costs, the key is no secret.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifdef __linux__
+#include <linux/tls.h>
+#endif
+#include "units.h"
+#include "ktls.h"
+
+extern int trans;
+extern int ktls;		/* cipher, 0 = cleartext */
+extern unsigned long nbytes;
+extern double cput, realt;
+
+void sys_err(char *s);
+char *outfmt(double b);
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+static struct {
+    char *name;
+    int cipher;
+} ciphers[] = {
+#ifdef TLS_TX
+    { "aes128", TLS_CIPHER_AES_GCM_128 },
+    { "aes256", TLS_CIPHER_AES_GCM_256 },
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    { "chacha20", TLS_CIPHER_CHACHA20_POLY1305 },
+#endif
+#endif
+    { NULL, 0 }
+};
+
+
+static char *
+ciphername(void)
+{
+    int i;
+
+    for (i = 0; ciphers[i].name; ++i)
+	if (ciphers[i].cipher == ktls)
+	    return(ciphers[i].name);
+    return("?");
+}
+
+
+/* the -e argument, 0 if it isn't one we know */
+int
+ktls_cipher(
+    char *name)
+{
+    int i;
+
+    for (i = 0; ciphers[i].name; ++i)
+	if (strcmp(name, ciphers[i].name) == 0)
+	    return(ciphers[i].cipher);
+    return(0);
+}
+
+
+#ifdef TLS_TX
+
+/* fill in a fixed, recognizable key; the same on both ends */
+static void
+fixed(
+    unsigned char *p,
+    int len,
+    int seed)
+{
+    int i;
+
+    for (i = 0; i < len; ++i)
+	p[i] = seed + i;
+}
+
+
+void
+ktls_setup(
+    int fd)
+{
+    union {
+	struct tls_crypto_info info;
+	struct tls12_crypto_info_aes_gcm_128 gcm128;
+	struct tls12_crypto_info_aes_gcm_256 gcm256;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+	struct tls12_crypto_info_chacha20_poly1305 chacha;
+#endif
+    } ci;
+    socklen_t len = 0;
+
+    memset(&ci, 0, sizeof(ci));
+    ci.info.version = TLS_1_2_VERSION;
+    ci.info.cipher_type = ktls;
+    switch (ktls) {
+    case TLS_CIPHER_AES_GCM_128:
+	fixed(ci.gcm128.key, sizeof(ci.gcm128.key), 0x10);
+	fixed(ci.gcm128.iv, sizeof(ci.gcm128.iv), 0x40);
+	fixed(ci.gcm128.salt, sizeof(ci.gcm128.salt), 0x60);
+	len = sizeof(ci.gcm128);
+	break;
+    case TLS_CIPHER_AES_GCM_256:
+	fixed(ci.gcm256.key, sizeof(ci.gcm256.key), 0x10);
+	fixed(ci.gcm256.iv, sizeof(ci.gcm256.iv), 0x40);
+	fixed(ci.gcm256.salt, sizeof(ci.gcm256.salt), 0x60);
+	len = sizeof(ci.gcm256);
+	break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case TLS_CIPHER_CHACHA20_POLY1305:
+	fixed(ci.chacha.key, sizeof(ci.chacha.key), 0x10);
+	fixed(ci.chacha.iv, sizeof(ci.chacha.iv), 0x40);
+	len = sizeof(ci.chacha);
+	break;
+#endif
+    }
+
+    if (setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) < 0)
+	sys_err("setsockopt: TCP_ULP tls (is the tls module loaded?)");
+    if (setsockopt(fd, SOL_TLS, trans ? TLS_TX : TLS_RX, &ci, len) < 0)
+	sys_err(trans ? "setsockopt: TLS_TX" : "setsockopt: TLS_RX");
+}
+
+#else /* no kTLS */
+
+void
+ktls_setup(
+    int fd)
+{
+    fprintf(stderr, "ttcp: -e: kernel TLS isn't supported here\n");
+    exit(1);
+}
+
+#endif
+
+
+void
+ktls_report(void)
+{
+    double gb = nbytes / GIGABYTE;
+
+    fprintf(stdout, "ttcp%s: kTLS %s: %s/sec, %.3f cpu sec/GB\n",
+	    trans ? "-t" : "-r", ciphername(),
+	    outfmt(realt > 0.0 ? nbytes / realt : 0.0),
+	    gb > 0.0 ? cput / gb : 0.0);
+}
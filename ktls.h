@@ -0,0 +1,3 @@
+int ktls_cipher(char *name);
+void ktls_setup(int fd);
+void ktls_report(void);
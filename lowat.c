@@ -0,0 +1,173 @@
+/*
+ * lowat.c - send only when the socket is writable below
+ *	     TCP_NOTSENT_LOWAT (-w), sampling the send queue as we go
+ *
+ * With a large SO_SNDBUF a blocking write() happily queues megabytes
+ * of unsent data, and anything sent after it waits for that to drain.
+ * Here the socket is non-blocking, writes happen only once epoll says
+ * the unsent part of the queue is below the low water mark, and every
+ * -w interval the unsent (SIOCOUTQNSD) and total unacked (SIOCOUTQ)
+ * queue sizes are recorded.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <linux/sockios.h>
+#endif
+#include "samples.h"
+#include "lowat.h"
+
+extern int verbose;
+extern int lowat;		/* TCP_NOTSENT_LOWAT bytes */
+extern int lowatms;		/* sampling interval, msecs */
+extern unsigned long numCalls;
+
+void sys_err(char *s);
+
+static int epfd = -1;
+static unsigned long nwaits;	/* times we had to wait for EPOLLOUT */
+static double waited;		/* seconds spent waiting */
+static double tstart, tnext;	/* for the sampling interval */
+static struct samples notsent;	/* unsent bytes in the queue */
+static struct samples outq;	/* unsent + unacked bytes */
+
+
+static double
+now_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+
+void
+lowat_setup(
+    int fd)
+{
+#if defined(TCP_NOTSENT_LOWAT) && defined(__linux__)
+    struct epoll_event ev;
+
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+		   (char *)&lowat, sizeof(lowat)) < 0)
+	sys_err("setsockopt: notsent_lowat");
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+	sys_err("fcntl: O_NONBLOCK");
+
+    if (epfd >= 0)
+	close(epfd);
+    if ((epfd = epoll_create1(0)) < 0)
+	sys_err("epoll_create1");
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLOUT;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	sys_err("epoll_ctl");
+
+    nwaits = 0;
+    waited = 0.0;
+    samples_free(&notsent);
+    samples_free(&outq);
+    tstart = tnext = now_secs();
+#else
+    fprintf(stderr, "ttcp-t: -w not supported on this system\n");
+    exit(1);
+#endif
+}
+
+
+static void
+lowat_sample(
+    int fd,
+    double now)
+{
+#ifdef __linux__
+    int unsent = 0, queued = 0;
+
+    if (ioctl(fd, SIOCOUTQNSD, &unsent) < 0 ||
+	ioctl(fd, SIOCOUTQ, &queued) < 0)
+	return;
+    samples_add(&notsent, unsent);
+    samples_add(&outq, queued);
+    if (verbose)
+	fprintf(stderr, "ttcp-t: %8.3f s  notsent %8d  outq %8d\n",
+		now - tstart, unsent, queued);
+#endif
+    tnext = now + lowatms / 1000.0;
+}
+
+
+/* write all of buf, waiting for EPOLLOUT whenever the socket is full */
+int
+lowat_write(
+    int fd,
+    void *buf,
+    int count)
+{
+#ifdef __linux__
+    struct epoll_event ev;
+    char *cp = buf;
+    int left = count;
+    int cnt, ms, n;
+    double now, t0;
+
+    while (left > 0) {
+	cnt = write(fd, cp, left);
+	numCalls++;
+	if (cnt > 0) {
+	    cp += cnt;
+	    left -= cnt;
+	} else if (cnt < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+	    return(cnt);
+	}
+	now = now_secs();
+	if (now >= tnext)
+	    lowat_sample(fd, now);
+	if (left > 0) {
+	    /*
+	     * below the low water mark again before writing more, still
+	     * sampling on time: the queue is at its fullest just now
+	     */
+	    t0 = now;
+	    ++nwaits;
+	    for (;;) {
+		ms = (tnext - now) * 1000.0 + 1;
+		if ((n = epoll_wait(epfd, &ev, 1, ms > 0 ? ms : 0)) > 0)
+		    break;
+		if (n < 0 && errno != EINTR)
+		    break;
+		now = now_secs();
+		if (now >= tnext)
+		    lowat_sample(fd, now);
+	    }
+	    waited += now_secs() - t0;
+	}
+    }
+    errno = 0;
+#endif
+    return(count);
+}
+
+
+void
+lowat_report(void)
+{
+    fprintf(stdout,
+	    "ttcp-t: notsent_lowat=%d: %lu waits for EPOLLOUT, %.2f sec waiting\n",
+	    lowat, nwaits, waited);
+    fprintf(stdout, "ttcp-t: notsent bytes: %s\n", samples_format(&notsent));
+    fprintf(stdout, "ttcp-t: outq bytes: %s\n", samples_format(&outq));
+}
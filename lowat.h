@@ -0,0 +1,3 @@
+void lowat_setup(int fd);
+int lowat_write(int fd, void *buf, int count);
+void lowat_report(void);
@@ -0,0 +1,195 @@
+/*
+ * mapio.c - move a file with mmap instead of stdin/stdout (-F)
+ *
+ * The transmitter maps the whole input file and writes it straight
+ * from the mapping in -l slices, asking for readahead well in front
+ * of where it is writing.  The receiver grows the output file a
+ * window at a time, reads from the network straight into the mapped
+ * window, and starts writeback of each window as it fills
+ * (sync_file_range(), as msync(MS_ASYNC) doesn't on Linux).  Each side keeps track of how long it spent on the disk
+ * (faulting in, allocating, syncing) and how long on the network,
+ * which tells which end of the pipe is holding things up.
+ *
+ * With kernel TLS (-e) the transmitter uses sendfile() instead, so
+ * the kernel encrypts straight from the page cache; it's all counted
+ * as network time then.
+ */
+
+#define _GNU_SOURCE		/* for sync_file_range() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include "mapio.h"
+
+extern int trans;
+extern int buflen;
+extern char *mapfile;
+extern int ktls;
+extern unsigned long nbytes;
+extern unsigned long numCalls;
+
+void sys_err(char *s);
+int Nread(int fd, void *buf, int count);
+int Nwrite(int fd, void *buf, int count);
+
+#define READAHEAD (8*1024*1024)	 /* how far ahead of the writes to prefetch */
+#define WINDOW	  (64*1024*1024) /* receiver maps the output this much at a time */
+
+static double disktime;		/* seconds spent on the file */
+static double nettime;		/* seconds spent on the socket */
+
+
+static double
+now_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+
+void
+mapsource(
+    int fd)
+{
+    volatile char sum = 0;
+    struct stat st;
+    long pagesize = sysconf(_SC_PAGESIZE);
+    char *map;
+    off_t off, ahead = 0;
+    double t0, t1;
+    int mfd;
+    int len, cnt;
+    off_t i;
+
+    disktime = nettime = 0.0;
+    if ((mfd = open(mapfile, O_RDONLY)) < 0 || fstat(mfd, &st) < 0)
+	sys_err(mapfile);
+    if (st.st_size == 0) {
+	close(mfd);
+	return;
+    }
+    if (ktls) {
+	t0 = now_secs();
+	for (off = 0; off < st.st_size; ) {
+	    len = (st.st_size - off < buflen) ? st.st_size - off : buflen;
+	    numCalls++;
+	    if ((cnt = sendfile(fd, mfd, &off, len)) <= 0)
+		break;		/* off has moved along */
+	    nbytes += cnt;
+	}
+	nettime = now_secs() - t0;
+	close(mfd);
+	return;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, mfd, 0);
+    if (map == MAP_FAILED)
+	sys_err("mmap");
+    (void)madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    for (off = 0; off < st.st_size; off += cnt) {
+	len = (st.st_size - off < buflen) ? st.st_size - off : buflen;
+
+	t0 = now_secs();
+	if (off + len > ahead && ahead < st.st_size) {
+	    /* keep the readahead a good distance in front of us */
+	    ahead = off - off % pagesize;
+	    (void)madvise(map + ahead,
+			  (st.st_size - ahead < READAHEAD) ?
+			  st.st_size - ahead : READAHEAD,
+			  MADV_WILLNEED);
+	    ahead += READAHEAD;
+	}
+	for (i = off - off % pagesize; i < off + len; i += pagesize)
+	    sum += map[i];	/* fault the slice in, on the disk's clock */
+	t1 = now_secs();
+	disktime += t1 - t0;
+
+	cnt = Nwrite(fd, map + off, len);
+	nettime += now_secs() - t1;
+	if (cnt <= 0)
+	    break;
+	nbytes += cnt;
+    }
+
+    munmap(map, st.st_size);
+    close(mfd);
+}
+
+
+void
+mapsink(
+    int fd)
+{
+    char *map = NULL;
+    off_t base = 0;		/* file offset of the mapped window */
+    off_t off = 0;		/* how far into the window we are */
+    double t0, t1;
+    int mfd;
+    int len, cnt;
+
+    disktime = nettime = 0.0;
+    if ((mfd = open(mapfile, O_RDWR | O_CREAT | O_TRUNC, 0666)) < 0)
+	sys_err(mapfile);
+
+    while (1) {
+	if (map == NULL || off == WINDOW) {
+	    t0 = now_secs();
+	    if (map != NULL) {
+		/* start writeback */
+		(void)sync_file_range(mfd, base, WINDOW, SYNC_FILE_RANGE_WRITE);
+		munmap(map, WINDOW);
+		base += WINDOW;
+		off = 0;
+	    }
+	    if ((errno = posix_fallocate(mfd, base, WINDOW)) != 0)
+		sys_err("posix_fallocate");
+	    map = mmap(NULL, WINDOW, PROT_READ|PROT_WRITE, MAP_SHARED,
+		       mfd, base);
+	    if (map == MAP_FAILED)
+		sys_err("mmap");
+	    disktime += now_secs() - t0;
+	}
+
+	len = (WINDOW - off < buflen) ? WINDOW - off : buflen;
+	t1 = now_secs();
+	cnt = Nread(fd, map + off, len);
+	nettime += now_secs() - t1;
+	if (cnt <= 0)
+	    break;
+	off += cnt;
+	nbytes += cnt;
+    }
+
+    t0 = now_secs();
+    (void)sync_file_range(mfd, base, off, SYNC_FILE_RANGE_WRITE);
+    munmap(map, WINDOW);
+    if (ftruncate(mfd, base + off) < 0)	/* drop the unused preallocation */
+	sys_err("ftruncate");
+    close(mfd);
+    disktime += now_secs() - t0;
+}
+
+
+void
+mapreport(void)
+{
+    double total = disktime + nettime;
+
+    if (total <= 0.0)
+	total = 0.001;
+    fprintf(stdout,
+	    "ttcp%s: %s: %.2f sec on disk (%.0f%%), %.2f sec on network (%.0f%%)\n",
+	    trans ? "-t" : "-r", mapfile,
+	    disktime, 100.0 * disktime / total,
+	    nettime, 100.0 * nettime / total);
+}
@@ -0,0 +1,3 @@
+void mapsource(int fd);
+void mapsink(int fd);
+void mapreport(void);
@@ -0,0 +1,323 @@
+/*
+ * micro.c - microbenchmarks for ttcp's own hot functions (make micro)
+ *
+ * Times touch() (the -T loop in Nread), pattern(), calc_tput(),
+ * outfmt() and the timeval helpers in isolation, compiled with the
+ * same flags as ttcp itself: ttcp.c and ticks.c are included here
+ * rather than linked so the static ones can be reached.
+ *
+ * Each function is run in a loop long enough to take a few msecs,
+ * several times, and the fastest trial is kept.  One line per
+ * benchmark goes to stdout:
+ *
+ *	name  bytes  ns/call  bytes/cycle
+ *
+ * bytes/cycle is against the TSC (x86 only, "-" elsewhere), which
+ * ticks at a fixed rate regardless of the core clock.  With -o the
+ * lines are also saved; with -c they are compared with a saved file
+ * from another build and the change in ns/call is added.
+ *
+ * usage: micro [-t trials] [-o file] [-c file]
+ */
+
+#define main ttcp_main
+#include "ttcp.c"
+#undef main
+#include "ticks.c"
+
+#include <sys/utsname.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+#define MINNS	5000000.0	/* each trial runs at least 5 msecs */
+
+static int trials = 7;
+static volatile unsigned long keep;	/* results go here so they're used */
+
+struct bench {
+    char *name;
+    int bytes;			/* per call, 0 if it doesn't apply */
+    void (*fn)(int bytes, long n);
+};
+
+struct result {
+    char name[32];
+    int bytes;
+    double ns;
+};
+
+
+static double
+nsnow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+static unsigned long long
+cycles(void)
+{
+#ifdef HAVE_TSC
+    return(__rdtsc());
+#else
+    return(0);
+#endif
+}
+
+
+static char *mbuf;
+
+static void
+b_touch(int bytes, long n)
+{
+    while (n--)
+	touch(mbuf, bytes);
+    keep = touchsum;
+}
+
+static void
+b_pattern(int bytes, long n)
+{
+    while (n--)
+	pattern(mbuf, bytes);
+    keep = mbuf[bytes - 1];
+}
+
+static void
+b_calc_tput(int bytes, long n)
+{
+    unsigned long b = 0;
+    float f = 0;
+
+    while (n--)
+	f += calc_tput(b += 8192);
+    keep = f;
+}
+
+static void
+b_outfmt(int bytes, long n)
+{
+    double b = 123456789.0;
+
+    while (n--)
+	keep += outfmt(b += 1.0)[0];
+}
+
+static void
+b_tv_plus(int bytes, long n)
+{
+    struct timeval a = { 1000, 999999 }, d = { 0, 1 };
+
+    while (n--)
+	a = tv_plus(a, d);
+    keep = a.tv_usec;
+}
+
+static void
+b_tv_minus(int bytes, long n)
+{
+    struct timeval a = { 1000000, 0 }, d = { 0, 3 };
+
+    while (n--)
+	a = tv_minus(a, d);
+    keep = a.tv_usec;
+}
+
+static void
+b_tv_cmp(int bytes, long n)
+{
+    struct timeval a = { 1000, 5 }, b = { 1000, 0 };
+
+    while (n--) {
+	keep += tv_cmp(a, b);
+	++b.tv_usec;
+    }
+}
+
+static void
+b_tv_ago_msecs(int bytes, long n)
+{
+    struct timeval t;
+
+    gettimeofday(&t, NULL);
+    while (n--)
+	keep += tv_ago_msecs(t);
+}
+
+static void
+b_tv_format(int bytes, long n)
+{
+    struct timeval t = { 1234, 567890 };
+
+    while (n--) {
+	keep += tv_format(t)[0];
+	++t.tv_usec;
+    }
+}
+
+static struct bench benches[] = {
+    { "touch",		1024,	b_touch },
+    { "touch",		8192,	b_touch },
+    { "touch",		65536,	b_touch },
+    { "touch",		1048576, b_touch },
+    { "pattern",	1024,	b_pattern },
+    { "pattern",	8192,	b_pattern },
+    { "pattern",	65536,	b_pattern },
+    { "calc_tput",	0,	b_calc_tput },
+    { "outfmt",		0,	b_outfmt },
+    { "tv_plus",	0,	b_tv_plus },
+    { "tv_minus",	0,	b_tv_minus },
+    { "tv_cmp",		0,	b_tv_cmp },
+    { "tv_ago_msecs",	0,	b_tv_ago_msecs },
+    { "tv_format",	0,	b_tv_format },
+};
+#define NBENCH (sizeof(benches) / sizeof(benches[0]))
+
+
+/* the fastest of the trials, in ns and TSC cycles per call */
+static void
+run(
+    struct bench *b,
+    double *pns,
+    double *pcyc)
+{
+    unsigned long long c0;
+    double t0, t;
+    long n = 1;
+    int i;
+
+    /* long enough that the clock reads don't matter */
+    for (;;) {
+	t0 = nsnow();
+	b->fn(b->bytes, n);
+	if (nsnow() - t0 >= MINNS)
+	    break;
+	n *= 2;
+    }
+
+    *pns = *pcyc = 0.0;
+    for (i = 0; i < trials; ++i) {
+	c0 = cycles();
+	t0 = nsnow();
+	b->fn(b->bytes, n);
+	t = (nsnow() - t0) / n;
+	if (i == 0 || t < *pns) {
+	    *pns = t;
+	    *pcyc = (double)(cycles() - c0) / n;
+	}
+    }
+}
+
+
+static int
+baseread(
+    char *file,
+    struct result *r,
+    int max)
+{
+    char line[256];
+    FILE *f;
+    int n = 0;
+
+    if ((f = fopen(file, "r")) == NULL) {
+	perror(file);
+	exit(1);
+    }
+    while (n < max && fgets(line, sizeof(line), f) != NULL) {
+	if (line[0] == '#')
+	    continue;
+	if (sscanf(line, "%31s %d %lf", r[n].name, &r[n].bytes, &r[n].ns) == 3)
+	    ++n;
+    }
+    fclose(f);
+    return(n);
+}
+
+
+int
+main(
+    int argc,
+    char **argv)
+{
+    struct result base[64];
+    struct utsname un;
+    char *save = NULL, *cmp = NULL;
+    double ns, cyc;
+    FILE *out = NULL;
+    int nbase = 0;
+    int c, i, j;
+
+    while ((c = getopt(argc, argv, "t:o:c:")) != -1) {
+	switch (c) {
+	case 't':
+	    if ((trials = atoi(optarg)) <= 0)
+		goto usage;
+	    break;
+	case 'o':
+	    save = optarg;
+	    break;
+	case 'c':
+	    cmp = optarg;
+	    break;
+	default:
+	    goto usage;
+	}
+    }
+    if (optind != argc)
+	goto usage;
+
+    if (cmp)
+	nbase = baseread(cmp, base, 64);
+    if (save && (out = fopen(save, "w")) == NULL) {
+	perror(save);
+	exit(1);
+    }
+    if ((mbuf = malloc(1048576)) == NULL)
+	sys_err("malloc");
+    pattern(mbuf, 1048576);
+    fmt = 'm';
+
+    (void)uname(&un);
+    printf("# ttcp micro, %s %s %s, best of %d\n",
+	   un.sysname, un.release, un.machine, trials);
+    printf("# name\tbytes\tns/call\tbytes/cycle%s\n", cmp ? "\tvs base" : "");
+    if (out) {
+	fprintf(out, "# ttcp micro, %s %s %s, best of %d\n",
+		un.sysname, un.release, un.machine, trials);
+	fprintf(out, "# name\tbytes\tns/call\tbytes/cycle\n");
+    }
+
+    for (i = 0; i < (int)NBENCH; ++i) {
+	char bpc[32];
+
+	run(&benches[i], &ns, &cyc);
+	if (benches[i].bytes && cyc > 0.0)
+	    snprintf(bpc, sizeof(bpc), "%.3f", benches[i].bytes / cyc);
+	else
+	    snprintf(bpc, sizeof(bpc), "-");
+	printf("%s\t%d\t%.2f\t%s", benches[i].name, benches[i].bytes, ns, bpc);
+	if (out)
+	    fprintf(out, "%s\t%d\t%.2f\t%s\n",
+		    benches[i].name, benches[i].bytes, ns, bpc);
+	for (j = 0; j < nbase; ++j)
+	    if (strcmp(base[j].name, benches[i].name) == 0 &&
+		base[j].bytes == benches[i].bytes)
+		break;
+	if (cmp && j < nbase && base[j].ns > 0.0)
+	    printf("\t%+.1f%%", 100.0 * (ns - base[j].ns) / base[j].ns);
+	else if (cmp)
+	    printf("\tnew");
+	printf("\n");
+    }
+    if (out)
+	fclose(out);
+    exit(0);
+
+usage:
+    fprintf(stderr, "usage: micro [-t trials] [-o file] [-c file]\n");
+    exit(1);
+}
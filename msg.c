@@ -0,0 +1,308 @@
+/*
+ * msg.c - RPC style message mode (-M)
+ *
+ * Rather than a stream of identical -l writes, the transmitter sends
+ * -n messages, each a 4 byte length in network order followed by that
+ * many bytes, with the lengths drawn from a distribution:
+ *
+ *	fixed:N		every message N bytes
+ *	uniform:LO,HI	evenly between LO and HI
+ *	exp:MEAN	exponentially distributed around MEAN
+ *	cdf:FILE	empirical, FILE has "size cumulative-probability"
+ *			lines in increasing order
+ *
+ * The receiver follows the framing and reports messages/sec and how
+ * long each message took to arrive once its first byte showed up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#include "samples.h"
+#include "msg.h"
+
+extern int trans;
+extern unsigned long nbytes;
+extern unsigned long numCalls;
+extern double realt;
+
+void sys_err(char *s);
+void pattern(register char *cp, register int cnt);
+int Nread(int fd, void *buf, int count);
+char *outfmt(double b);
+
+#define MAXMSG	(64*1024*1024)	/* largest message we'll make or take */
+#define MAXCDF	1024		/* points in an empirical distribution */
+
+static enum { FIXED, UNIFORM, EXPONENTIAL, EMPIRICAL } dist;
+static double arg1, arg2;
+static int cdfsize[MAXCDF];
+static double cdfprob[MAXCDF];
+static int ncdf;
+
+static unsigned long nmsgs;	/* messages sent or received */
+static struct samples latency;	/* receiver: first byte to last, usecs */
+
+
+static double
+now_usecs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec * 1e6 + ts.tv_nsec / 1e3);
+}
+
+
+static void
+msgbad(
+    char *spec)
+{
+    fprintf(stderr,
+	    "ttcp: bad -M %s, expected fixed:N, uniform:LO,HI, exp:MEAN or cdf:FILE\n",
+	    spec);
+    exit(1);
+}
+
+
+static void
+cdfread(
+    char *file)
+{
+    char line[256];
+    FILE *f;
+
+    if ((f = fopen(file, "r")) == NULL) {
+	perror(file);
+	exit(1);
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+	if (line[0] == '#')
+	    continue;
+	if (ncdf == MAXCDF) {
+	    fprintf(stderr, "ttcp: %s: more than %d points\n", file, MAXCDF);
+	    exit(1);
+	}
+	if (sscanf(line, "%d %lf", &cdfsize[ncdf], &cdfprob[ncdf]) == 2)
+	    ++ncdf;
+    }
+    fclose(f);
+    if (ncdf == 0) {
+	fprintf(stderr, "ttcp: %s: no \"size probability\" lines\n", file);
+	exit(1);
+    }
+}
+
+
+void
+msgopt(
+    char *spec)
+{
+    char *colon = strchr(spec, ':');
+
+    if (colon == NULL)
+	msgbad(spec);
+    if (strncmp(spec, "fixed:", 6) == 0) {
+	dist = FIXED;
+	arg1 = atof(colon + 1);
+    } else if (strncmp(spec, "uniform:", 8) == 0) {
+	dist = UNIFORM;
+	if (sscanf(colon + 1, "%lf,%lf", &arg1, &arg2) != 2 || arg2 < arg1)
+	    msgbad(spec);
+    } else if (strncmp(spec, "exp:", 4) == 0) {
+	dist = EXPONENTIAL;
+	arg1 = atof(colon + 1);
+    } else if (strncmp(spec, "cdf:", 4) == 0) {
+	dist = EMPIRICAL;
+	cdfread(colon + 1);
+    } else {
+	msgbad(spec);
+    }
+    if (dist != EMPIRICAL && arg1 < 0)
+	msgbad(spec);
+}
+
+
+static int
+msgsize(void)
+{
+    double u = drand48();
+    double size = 0;
+    int i;
+
+    switch (dist) {
+      case FIXED:
+	size = arg1;
+	break;
+      case UNIFORM:
+	size = arg1 + u * (arg2 - arg1 + 1);
+	break;
+      case EXPONENTIAL:
+	size = -arg1 * log(1.0 - u);
+	break;
+      case EMPIRICAL:
+	for (i=0; i < ncdf-1 && cdfprob[i] < u; ++i)
+	    ;
+	size = cdfsize[i];
+	break;
+    }
+    if (size < 0)
+	size = 0;
+    if (size > MAXMSG)
+	size = MAXMSG;
+
+    return((int) size);
+}
+
+
+/* the largest message msgsize() can come up with */
+static int
+msgmax(void)
+{
+    double max = MAXMSG;	/* exp: no bound short of ours */
+    int i;
+
+    switch (dist) {
+      case FIXED:
+	max = arg1;
+	break;
+      case UNIFORM:
+	max = arg2 + 1;
+	break;
+      case EXPONENTIAL:
+	break;
+      case EMPIRICAL:
+	max = 0;
+	for (i=0; i < ncdf; ++i)
+	    if (cdfsize[i] > max)
+		max = cdfsize[i];
+	break;
+    }
+    if (max < 1)
+	max = 1;
+    if (max > MAXMSG)
+	max = MAXMSG;
+
+    return((int) max);
+}
+
+
+/* send count messages */
+void
+msg_source(
+    int fd,
+    int count)
+{
+    static char *payload;
+    struct iovec iov[2];
+    uint32_t hdr;
+    int len, left, cnt;
+
+    if (payload == NULL) {
+	/* only as big as the distribution needs, it's patterned up front */
+	if ((payload = malloc(msgmax())) == NULL)
+	    sys_err("malloc");
+	pattern(payload, msgmax());
+    }
+
+    nmsgs = 0;
+    srand48(1);			/* the same sizes every run */
+    while (count-- > 0) {
+	len = msgsize();
+	hdr = htonl(len);
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(hdr);
+	iov[1].iov_base = payload;
+	iov[1].iov_len = len;
+	for (left = len + sizeof(hdr); left > 0; left -= cnt) {
+	    cnt = writev(fd, iov, 2);
+	    numCalls++;
+	    if (cnt <= 0)
+		return;
+	    nbytes += cnt;
+	    /* step past what went out */
+	    if (cnt >= iov[0].iov_len) {
+		iov[1].iov_base = (char *)iov[1].iov_base + (cnt - iov[0].iov_len);
+		iov[1].iov_len -= cnt - iov[0].iov_len;
+		iov[0].iov_len = 0;
+	    } else {
+		iov[0].iov_base = (char *)iov[0].iov_base + cnt;
+		iov[0].iov_len -= cnt;
+	    }
+	}
+	++nmsgs;
+    }
+}
+
+
+/* follow the framing until EOF */
+void
+msg_sink(
+    int fd,
+    char *buf,
+    int buflen)
+{
+    unsigned char hdr[4];
+    int hdrhave = 0;		/* header bytes collected */
+    uint32_t left = 0;		/* body bytes still to come */
+    int inmsg = 0;		/* somewhere inside a message */
+    double started = 0.0;	/* when its first byte was read */
+    double now;
+    char *cp;
+    int cnt;
+
+    nmsgs = 0;
+    samples_free(&latency);
+    while ((cnt = Nread(fd, buf, buflen)) > 0) {
+	now = now_usecs();
+	nbytes += cnt;
+	for (cp = buf; cnt > 0; ) {
+	    if (!inmsg) {
+		inmsg = 1;
+		started = now;
+	    }
+	    if (hdrhave < sizeof(hdr)) {
+		hdr[hdrhave++] = *cp++;
+		--cnt;
+		if (hdrhave < sizeof(hdr))
+		    continue;
+		left = ((uint32_t)hdr[0] << 24) | (hdr[1] << 16) |
+		    (hdr[2] << 8) | hdr[3];
+	    } else {
+		int n = left < cnt ? left : cnt;
+		cp += n;
+		cnt -= n;
+		left -= n;
+	    }
+	    if (hdrhave == sizeof(hdr) && left == 0) {
+		/* message complete */
+		++nmsgs;
+		samples_add(&latency, now - started);
+		hdrhave = 0;
+		inmsg = 0;
+	    }
+	}
+    }
+}
+
+
+void
+msg_report(void)
+{
+    char *side = trans ? "-t" : "-r";
+
+    fprintf(stdout,
+	    "ttcp%s: %lu messages in %.2f real seconds = %.2f msgs/sec, mean %.0f bytes\n",
+	    side, nmsgs, realt, nmsgs / realt,
+	    nmsgs ? (double) nbytes / nmsgs - 4 : 0.0);
+    if (!trans)
+	fprintf(stdout, "ttcp-r: message completion usecs: %s\n",
+		samples_format(&latency));
+}
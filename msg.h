@@ -0,0 +1,4 @@
+void msgopt(char *spec);
+void msg_source(int fd, int count);
+void msg_sink(int fd, char *buf, int buflen);
+void msg_report(void);
@@ -0,0 +1,231 @@
+/*
+ * pktring.c - receive the UDP test flow from a TPACKET_V3 ring (-N)
+ *
+ * With one recvfrom() per datagram the receiver runs out of CPU well
+ * before a fast sender does, and then the loss it reports is its own.
+ * Here an AF_PACKET socket on the given interface, with a BPF filter
+ * for UDP to our port, has the kernel fill a ring of blocks that are
+ * mapped into our address space; we walk each block's packets when
+ * the kernel hands it over, and hand it back.  The ordinary UDP socket
+ * stays bound (so nobody gets port unreachables) but isn't read.
+ * Drops are the ring's own, from PACKET_STATISTICS.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#ifdef __linux__
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#endif
+#include "pktring.h"
+
+extern int fd;
+extern short port;
+extern char *ringif;		/* interface to capture on */
+extern unsigned long nbytes;
+extern unsigned long numCalls;
+extern double realt;
+
+void sys_err(char *s);
+void prep_timer(void);
+char *outfmt(double b);
+
+#ifdef TPACKET3_HDRLEN
+
+#define BLOCKSIZE (1 << 22)	/* 4MB blocks */
+#define NBLOCKS	  64
+#define FRAMESIZE 2048		/* only a hint with V3 */
+#define RETIRE_MS 10		/* hand over part full blocks this often */
+
+static int pfd = -1;
+static char *ring;
+static unsigned long datagrams;
+static unsigned long blocks;
+static unsigned long drops;	/* from the kernel */
+static unsigned long seen;	/*  out of this many */
+static unsigned long freezes;
+
+
+void
+pktring_setup(void)
+{
+    struct tpacket_req3 req;
+    struct sockaddr_ll sll;
+    struct sock_fprog prog;
+    int v = TPACKET_V3;
+    int small = 4096;
+    /* udp dst port == port, IPv4, not a fragment */
+    struct sock_filter filter[] = {
+	{ 0x28, 0, 0, 12 },		/* ldh [12]		*/
+	{ 0x15, 0, 8, ETH_P_IP },	/* jeq #0x800		*/
+	{ 0x30, 0, 0, 23 },		/* ldb [23]		*/
+	{ 0x15, 0, 6, IPPROTO_UDP },	/* jeq #17		*/
+	{ 0x28, 0, 0, 20 },		/* ldh [20]		*/
+	{ 0x45, 4, 0, 0x1fff },		/* jset #0x1fff		*/
+	{ 0xb1, 0, 0, 14 },		/* ldxb 4*([14]&0xf)	*/
+	{ 0x48, 0, 0, 16 },		/* ldh [x+16]		*/
+	{ 0x15, 0, 1, 0 },		/* jeq #port		*/
+	{ 0x06, 0, 0, 0x40000 },	/* ret #262144		*/
+	{ 0x06, 0, 0, 0 },		/* ret #0		*/
+    };
+
+    filter[8].k = (unsigned short)port;
+    prog.len = sizeof(filter) / sizeof(filter[0]);
+    prog.filter = filter;
+
+    if ((pfd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_IP))) < 0)
+	sys_err("socket: AF_PACKET");
+    if (setsockopt(pfd, SOL_PACKET, PACKET_VERSION, &v, sizeof(v)) < 0)
+	sys_err("setsockopt: PACKET_VERSION");
+#ifdef PACKET_IGNORE_OUTGOING
+    /* on lo we'd see everything twice */
+    (void)setsockopt(pfd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &v, sizeof(v));
+#endif
+    if (setsockopt(pfd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0)
+	sys_err("setsockopt: SO_ATTACH_FILTER");
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = BLOCKSIZE;
+    req.tp_block_nr = NBLOCKS;
+    req.tp_frame_size = FRAMESIZE;
+    req.tp_frame_nr = (BLOCKSIZE / FRAMESIZE) * NBLOCKS;
+    req.tp_retire_blk_tov = RETIRE_MS;
+    if (setsockopt(pfd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+	sys_err("setsockopt: PACKET_RX_RING");
+    ring = mmap(NULL, (size_t)BLOCKSIZE * NBLOCKS, PROT_READ|PROT_WRITE,
+		MAP_SHARED | MAP_LOCKED, pfd, 0);
+    if (ring == MAP_FAILED)
+	ring = mmap(NULL, (size_t)BLOCKSIZE * NBLOCKS, PROT_READ|PROT_WRITE,
+		    MAP_SHARED, pfd, 0);
+    if (ring == MAP_FAILED)
+	sys_err("mmap: packet ring");
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    if ((sll.sll_ifindex = if_nametoindex(ringif)) == 0)
+	sys_err(ringif);
+    if (bind(pfd, (struct sockaddr *)&sll, sizeof(sll)) < 0)
+	sys_err("bind: AF_PACKET");
+
+    /* nothing reads the UDP socket, don't let it hoard memory */
+    (void)setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+}
+
+
+/* what a block held; returns 1 once the end sentinel has gone by */
+static int
+walkblock(
+    struct tpacket_block_desc *pbd,
+    int *going)
+{
+    struct tpacket3_hdr *ppd;
+    struct sockaddr_ll *psll;
+    unsigned char *ip;
+    int i, ihl, len;
+
+    ppd = (struct tpacket3_hdr *)((char *)pbd + pbd->hdr.bh1.offset_to_first_pkt);
+    for (i = 0; i < pbd->hdr.bh1.num_pkts; ++i,
+	 ppd = (struct tpacket3_hdr *)((char *)ppd + ppd->tp_next_offset)) {
+	psll = (struct sockaddr_ll *)((char *)ppd + TPACKET_ALIGN(sizeof(*ppd)));
+	if (psll->sll_pkttype == PACKET_OUTGOING)
+	    continue;
+	ip = (unsigned char *)ppd + ppd->tp_net;
+	ihl = (ip[0] & 0xf) * 4;
+	len = ((ip[ihl + 4] << 8) | ip[ihl + 5]) - 8;	/* udp length */
+
+	if (len <= 4) {
+	    /* the same sentinels the socket receiver looks for */
+	    if (*going && nbytes)
+		return(1);
+	    if (!*going) {
+		*going = 1;
+		prep_timer();
+	    }
+	    continue;
+	}
+	if (*going) {
+	    ++datagrams;
+	    nbytes += len;
+	}
+    }
+    return(0);
+}
+
+
+void
+pktring_sink(void)
+{
+    struct tpacket_block_desc *pbd;
+    struct tpacket_stats_v3 st;
+    struct pollfd pfds;
+    socklen_t stlen = sizeof(st);
+    int going = 0, done = 0;
+    int b = 0;
+
+    datagrams = blocks = 0;
+    (void)getsockopt(pfd, SOL_PACKET, PACKET_STATISTICS, &st, &stlen);
+
+    while (!done) {
+	pbd = (struct tpacket_block_desc *)(ring + (size_t)b * BLOCKSIZE);
+	if (!(pbd->hdr.bh1.block_status & TP_STATUS_USER)) {
+	    pfds.fd = pfd;
+	    pfds.events = POLLIN | POLLERR;
+	    pfds.revents = 0;
+	    if (poll(&pfds, 1, -1) < 0 && errno != EINTR)
+		sys_err("poll");
+	    continue;
+	}
+	done = walkblock(pbd, &going);
+	++blocks;
+	numCalls++;
+	__sync_synchronize();
+	pbd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+	b = (b + 1) % NBLOCKS;
+    }
+
+    /* reading the statistics also clears them */
+    stlen = sizeof(st);
+    if (getsockopt(pfd, SOL_PACKET, PACKET_STATISTICS, &st, &stlen) == 0) {
+	seen = st.tp_packets;
+	drops = st.tp_drops;
+	freezes = st.tp_freeze_q_cnt;
+    }
+}
+
+
+void
+pktring_report(void)
+{
+    fprintf(stdout,
+	    "ttcp-r: TPACKET_V3 ring on %s: %lu datagrams (%.0f/sec) in %lu blocks\n",
+	    ringif, datagrams, realt > 0.0 ? datagrams / realt : 0.0, blocks);
+    fprintf(stdout,
+	    "ttcp-r: ring drops %lu of %lu packets (%.3f%%), queue frozen %lu times\n",
+	    drops, seen, seen ? 100.0 * drops / seen : 0.0, freezes);
+}
+
+#else /* no TPACKET_V3 */
+
+void
+pktring_setup(void)
+{
+    fprintf(stderr, "ttcp: -N: TPACKET_V3 isn't supported here\n");
+    exit(1);
+}
+
+void pktring_sink(void) {}
+void pktring_report(void) {}
+
+#endif
@@ -0,0 +1,3 @@
+void pktring_setup(void);
+void pktring_sink(void);
+void pktring_report(void);
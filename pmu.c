@@ -0,0 +1,173 @@
+/*
+ * pmu.c - hardware performance counters around the timed part (-H)
+ *
+ * The counters are opened once with perf_event_open(), disabled, and
+ * then reset and enabled by prep_timer() and disabled by read_timer(),
+ * so they cover exactly what the times do.  They follow any threads
+ * started afterwards, so they're opened only once a -k or -G receiver
+ * has forked the child for a connection; opened in the parent, every
+ * session would count into, and reset, the same events.  Kernel time is counted too when the system
+ * allows it (perf_event_paranoid), user time only otherwise.  Each
+ * counter is opened on its own, so one the CPU (or VM) doesn't have
+ * just drops out of the report.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+#include "pmu.h"
+
+extern int trans;
+extern unsigned long nbytes;
+extern unsigned long numCalls;
+
+#ifdef PERF_EVENT_IOC_RESET
+
+static struct counter {
+    char *name;
+    uint32_t type;
+    uint64_t config;
+    int fd;
+    double value;		/* scaled for multiplexing */
+} counters[] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1, 0 },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1, 0 },
+    { "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1, 0 },
+    { "LLC-misses", PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_LL |
+      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), -1, 0 },
+    { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1, 0 },
+    { NULL, 0, 0, -1, 0 }
+};
+
+static int useronly;		/* couldn't count the kernel */
+static int opened;
+
+
+static int
+perfopen(
+    struct counter *pc,
+    int exclude_kernel)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = pc->type;
+    attr.config = pc->config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_kernel = exclude_kernel;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+
+void
+pmu_open(void)
+{
+    struct counter *pc;
+
+    for (pc = counters; pc->name; ++pc) {
+	pc->fd = perfopen(pc, useronly);
+	if (pc->fd < 0 && !useronly && (errno == EACCES || errno == EPERM)) {
+	    useronly = 1;
+	    pc->fd = perfopen(pc, 1);
+	}
+	if (pc->fd >= 0)
+	    ++opened;
+    }
+    if (!opened)
+	fprintf(stderr, "ttcp%s: -H: no hardware counters available: %s\n",
+		trans ? "-t" : "-r", strerror(errno));
+}
+
+
+void
+pmu_start(void)
+{
+    struct counter *pc;
+
+    for (pc = counters; pc->name; ++pc) {
+	if (pc->fd < 0)
+	    continue;
+	ioctl(pc->fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(pc->fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+
+void
+pmu_stop(void)
+{
+    struct counter *pc;
+    uint64_t v[3];		/* value, time enabled, time running */
+
+    for (pc = counters; pc->name; ++pc) {
+	if (pc->fd < 0)
+	    continue;
+	ioctl(pc->fd, PERF_EVENT_IOC_DISABLE, 0);
+	pc->value = 0.0;
+	if (read(pc->fd, v, sizeof(v)) == sizeof(v) && v[2] > 0)
+	    pc->value = (double)v[0] * v[1] / v[2];
+    }
+}
+
+
+void
+pmu_report(void)
+{
+    struct counter *pc;
+    double cycles = 0.0, instrs = 0.0;
+
+    if (!opened)
+	return;
+    for (pc = counters; pc->name; ++pc) {
+	if (pc->fd < 0)
+	    continue;
+	if (pc->config == PERF_COUNT_HW_CPU_CYCLES &&
+	    pc->type == PERF_TYPE_HARDWARE)
+	    cycles = pc->value;
+	if (pc->config == PERF_COUNT_HW_INSTRUCTIONS &&
+	    pc->type == PERF_TYPE_HARDWARE)
+	    instrs = pc->value;
+	fprintf(stdout,
+		"ttcp%s: %-13s %15.0f  %10.3f/byte  %12.1f/call\n",
+		trans ? "-t" : "-r", pc->name, pc->value,
+		nbytes ? pc->value / nbytes : 0.0,
+		numCalls ? pc->value / numCalls : 0.0);
+    }
+    fprintf(stdout, "ttcp%s: counted %s",
+	    trans ? "-t" : "-r",
+	    useronly ? "user only (see perf_event_paranoid)" : "user+kernel");
+    if (cycles > 0.0 && instrs > 0.0)
+	fprintf(stdout, ", %.2f instructions/cycle", instrs / cycles);
+    fprintf(stdout, "\n");
+}
+
+#else /* no perf events */
+
+void
+pmu_open(void)
+{
+    fprintf(stderr, "ttcp%s: -H: no perf_event_open on this system\n",
+	    trans ? "-t" : "-r");
+}
+
+void pmu_start(void) {}
+void pmu_stop(void) {}
+void pmu_report(void) {}
+
+#endif
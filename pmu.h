@@ -0,0 +1,4 @@
+void pmu_open(void);
+void pmu_start(void);
+void pmu_stop(void);
+void pmu_report(void);
@@ -0,0 +1,158 @@
+/*
+ * repeat.c - statistics over repeated runs (-R), and comparing them
+ *	      with a saved baseline (-o to save, -c to compare)
+ *
+ * Each run contributes its throughput and the CPU seconds it spent
+ * per gigabyte.  A metric is flagged as a regression when Welch's
+ * t test says the new mean is worse than the baseline's at 95%.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "samples.h"
+#include "units.h"
+#include "repeat.h"
+
+extern int trans;
+extern int udp;
+extern int buflen;
+extern int nbuf;
+extern char *basesave;		/* -o: write the runs here */
+extern char *basefile;		/* -c: compare the runs with these */
+
+char *outfmt(double b);
+char *transport(void);
+
+static struct samples tput;	/* bytes/sec of each run */
+static struct samples cpugb;	/* CPU seconds per gigabyte */
+
+
+void
+runsample(
+    unsigned long bytes,
+    double realt,
+    double cput)
+{
+    samples_add(&tput, bytes / realt);
+    samples_add(&cpugb, bytes ? cput * GIGABYTE / bytes : 0.0);
+}
+
+
+static void
+basewrite(
+    char *file)
+{
+    FILE *f;
+    int i;
+
+    if ((f = fopen(file, "w")) == NULL) {
+	perror(file);
+	exit(1);
+    }
+    fprintf(f, "# ttcp%s baseline: buflen=%d, nbuf=%d  %s\n",
+	    trans ? "-t" : "-r", buflen, nbuf, transport());
+    fprintf(f, "# bytes/sec  cpu-sec/GB\n");
+    for (i=0; i < tput.n; ++i)
+	fprintf(f, "%.1f %.6f\n", tput.v[i], cpugb.v[i]);
+    fclose(f);
+}
+
+
+static void
+baseread(
+    char *file,
+    struct samples *pbtput,
+    struct samples *pbcpu)
+{
+    char line[256];
+    double t, c;
+    FILE *f;
+
+    if ((f = fopen(file, "r")) == NULL) {
+	perror(file);
+	exit(1);
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+	if (line[0] == '#')
+	    continue;
+	if (sscanf(line, "%lf %lf", &t, &c) == 2) {
+	    samples_add(pbtput, t);
+	    samples_add(pbcpu, c);
+	}
+    }
+    fclose(f);
+}
+
+
+/* compare one metric with its baseline, 1 if it got significantly worse */
+static int
+basecompare(
+    char *name,
+    struct samples *pnew,
+    struct samples *pbase,
+    int higher_is_better)
+{
+    char *side = trans ? "-t" : "-r";
+    double bmean = samples_mean(pbase);
+    double t, df;
+    int worse;
+
+    t = samples_welch(pnew, pbase, &df);
+    worse = (df > 0.0) && (fabs(t) > t975(df)) &&
+	(higher_is_better ? t < 0 : t > 0);
+    fprintf(stdout, "ttcp%s: vs baseline: %s %+.1f%% (t=%.2f, df=%.1f) %s\n",
+	    side, name,
+	    bmean ? 100.0 * (samples_mean(pnew) - bmean) / bmean : 0.0,
+	    t, df, worse ? "REGRESSION" : "ok");
+
+    return(worse);
+}
+
+
+/* print the summary, the exit status is 2 if there was a regression */
+int
+runsummary(void)
+{
+    char *side = trans ? "-t" : "-r";
+    struct samples btput, bcpu;
+    double mean, ci;
+    int regress = 0;
+
+    mean = samples_mean(&tput);
+    ci = samples_ci95(&tput);
+    fprintf(stdout, "ttcp%s: %d runs: throughput mean %s/sec",
+	    side, tput.n, outfmt(mean));
+    fprintf(stdout, ", sd %.1f%%", mean ? 100.0 * samples_stddev(&tput) / mean : 0.0);
+    fprintf(stdout, ", median %s/sec\n", outfmt(samples_median(&tput)));
+    fprintf(stdout, "ttcp%s: %d runs: throughput 95%% CI %s",
+	    side, tput.n, outfmt(mean - ci));
+    fprintf(stdout, " .. %s/sec\n", outfmt(mean + ci));
+
+    mean = samples_mean(&cpugb);
+    ci = samples_ci95(&cpugb);
+    fprintf(stdout,
+	    "ttcp%s: %d runs: CPU sec/GB mean %.3f, sd %.3f, median %.3f, 95%% CI %.3f .. %.3f\n",
+	    side, cpugb.n, mean, samples_stddev(&cpugb),
+	    samples_median(&cpugb), mean - ci, mean + ci);
+
+    if (basefile) {
+	samples_init(&btput);
+	samples_init(&bcpu);
+	baseread(basefile, &btput, &bcpu);
+	if (btput.n < 2) {
+	    fprintf(stderr, "ttcp%s: %s: need at least 2 baseline runs\n",
+		    side, basefile);
+	    exit(1);
+	}
+	regress |= basecompare("throughput", &tput, &btput, 1);
+	regress |= basecompare("CPU sec/GB", &cpugb, &bcpu, 0);
+	samples_free(&btput);
+	samples_free(&bcpu);
+    }
+    if (basesave)
+	basewrite(basesave);
+
+    return(regress ? 2 : 0);
+}
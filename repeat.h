@@ -0,0 +1,2 @@
+void runsample(unsigned long bytes, double realt, double cput);
+int runsummary(void);
@@ -0,0 +1,436 @@
+/*
+ * ring.c - pipeline stdin/stdout through a ring of buffers (-Q)
+ *
+ * Without -s the receiver normally reads a buffer from the network and
+ * then writes it to stdout before reading the next, so a slow disk
+ * stops the socket from draining and the window closes.  Here the
+ * network thread fills a ring of -l sized, -A aligned buffers and one
+ * or more writer threads empty it into stdout.  When stdout is a
+ * regular file the writers use O_DIRECT and pwrite() each buffer at
+ * its own offset, so several can be outstanding at once.
+ *
+ * The transmitter has the same problem the other way around, reading
+ * stdin and writing the network in turn; there a reader thread keeps
+ * the ring full from stdin while the network thread drains it.
+ *
+ * The ring keeps track of how full it was each time a buffer was
+ * queued, and how long each side sat waiting for the other.
+ */
+
+#define _GNU_SOURCE		/* for O_DIRECT */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "ring.h"
+
+extern int trans;
+extern int udp;
+extern int buflen;
+extern int bufalign;
+extern int bufoffset;
+extern int ringslots;		/* buffers in the ring */
+extern int ringthreads;		/* disk threads */
+extern unsigned long nbytes;
+
+void sys_err(char *s);
+int Nread(int fd, void *buf, int count);
+int Nwrite(int fd, void *buf, int count);
+
+#define DIRECTALIGN 4096	/* what O_DIRECT wants, to be safe */
+
+#define SLOT_FREE	0
+#define SLOT_FULL	1
+#define SLOT_BUSY	2	/* being written */
+
+struct slot {
+    char *buf;
+    char *mem;			/* buf before it was aligned, to free() */
+    int len;
+    off_t off;			/* where it goes in the file */
+    int state;
+};
+
+static struct slot *slots;
+static int head;		/* next slot to fill */
+static int tail;		/* next slot to empty */
+static int inuse;		/* slots not free */
+static int done;		/* no more will be filled */
+static int failed;		/* errno from the disk side */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t freed = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t filled = PTHREAD_COND_INITIALIZER;
+
+static int direct;		/* using O_DIRECT */
+static int seekable;		/* pwrite() at offsets */
+static int diskfd;
+static int nthr;		/* disk threads actually running */
+static off_t diskbase;		/* file offset we started at */
+
+static unsigned long queued;	/* buffers through the ring */
+static unsigned long occsum;	/* sum of occupancy at each queue */
+static int occmax;
+static unsigned long fullwaits;	/* times the network found it full */
+static double netwait;		/* network side waiting on the disk */
+static double diskwait;		/* disk side waiting on the network */
+static double disktime;		/* disk side in write() */
+
+
+static double
+now_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+
+static void
+ring_init(void)
+{
+    int align = bufalign;
+    char *p;
+    int i;
+
+    if (direct && align < DIRECTALIGN)
+	align = DIRECTALIGN;
+    slots = calloc(ringslots, sizeof(struct slot));
+    if (slots == NULL)
+	sys_err("calloc");
+    for (i = 0; i < ringslots; ++i) {
+	if ((p = malloc(buflen + align)) == NULL)
+	    sys_err("malloc");
+	slots[i].mem = p;
+	if (align != 0)
+	    p += (align - ((unsigned long)p % align) + bufoffset) % align;
+	slots[i].buf = p;
+	slots[i].state = SLOT_FREE;
+    }
+    head = tail = inuse = done = failed = 0;
+    queued = occsum = fullwaits = 0;
+    occmax = 0;
+    netwait = diskwait = disktime = 0.0;
+}
+
+
+/* filling side: wait for the next free slot */
+static struct slot *
+ring_get(
+    double *waited)
+{
+    struct slot *ps = &slots[head];
+    double t0;
+
+    pthread_mutex_lock(&lock);
+    if (ps->state != SLOT_FREE) {
+	++fullwaits;
+	t0 = now_secs();
+	while (ps->state != SLOT_FREE && !failed)
+	    pthread_cond_wait(&freed, &lock);
+	*waited += now_secs() - t0;
+    }
+    pthread_mutex_unlock(&lock);
+    return(failed ? NULL : ps);
+}
+
+
+/* filling side: hand the slot from ring_get() to the other side */
+static void
+ring_put(
+    struct slot *ps)
+{
+    pthread_mutex_lock(&lock);
+    ps->state = SLOT_FULL;
+    head = (head + 1) % ringslots;
+    ++inuse;
+    ++queued;
+    occsum += inuse;
+    if (inuse > occmax)
+	occmax = inuse;
+    pthread_cond_signal(&filled);
+    pthread_mutex_unlock(&lock);
+}
+
+
+/* filling side: nothing more is coming */
+static void
+ring_finish(void)
+{
+    pthread_mutex_lock(&lock);
+    done = 1;
+    pthread_cond_broadcast(&filled);
+    pthread_mutex_unlock(&lock);
+}
+
+
+/* emptying side: wait for the next full slot, NULL once there are no more */
+static struct slot *
+ring_take(
+    double *waited)
+{
+    struct slot *ps = NULL;
+    double t0;
+
+    pthread_mutex_lock(&lock);
+    t0 = now_secs();
+    while (slots[tail].state != SLOT_FULL && !done && !failed)
+	pthread_cond_wait(&filled, &lock);
+    *waited += now_secs() - t0;
+    if (slots[tail].state == SLOT_FULL && !failed) {
+	ps = &slots[tail];
+	ps->state = SLOT_BUSY;
+	tail = (tail + 1) % ringslots;
+    }
+    pthread_mutex_unlock(&lock);
+    return(ps);
+}
+
+
+/* emptying side: done with the slot from ring_take(), err if it failed */
+static void
+ring_release(
+    struct slot *ps,
+    int err)
+{
+    pthread_mutex_lock(&lock);
+    if (err && !failed)
+	failed = err;
+    ps->state = SLOT_FREE;
+    --inuse;
+    pthread_cond_broadcast(&freed);
+    pthread_cond_broadcast(&filled);
+    pthread_mutex_unlock(&lock);
+}
+
+
+/* set up stdin or stdout for the disk side */
+static void
+disk_open(
+    int dfd)
+{
+    struct stat st;
+
+    diskfd = dfd;
+    direct = seekable = 0;
+    if (fstat(diskfd, &st) == 0 && S_ISREG(st.st_mode) &&
+	(diskbase = lseek(diskfd, 0, SEEK_CUR)) >= 0) {
+	seekable = 1;
+#ifdef POSIX_FADV_SEQUENTIAL
+	if (trans)
+	    (void)posix_fadvise(diskfd, diskbase, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	/* each buffer has to start on a block in the file, too */
+#ifdef O_DIRECT
+	if (!udp && buflen % DIRECTALIGN == 0 && bufoffset == 0 &&
+	    diskbase % DIRECTALIGN == 0 &&
+	    fcntl(diskfd, F_SETFL, fcntl(diskfd, F_GETFL) | O_DIRECT) == 0)
+	    direct = 1;
+#endif
+    }
+}
+
+
+/* leave the file as if it had been read or written the usual way */
+static void
+disk_close(
+    off_t end)
+{
+    int i;
+
+#ifdef O_DIRECT
+    if (direct) {
+	(void)fcntl(diskfd, F_SETFL, fcntl(diskfd, F_GETFL) & ~O_DIRECT);
+	if (!trans && ftruncate(diskfd, diskbase + end) < 0)
+	    sys_err("ftruncate");
+    }
+#endif
+    if (seekable)
+	(void)lseek(diskfd, diskbase + end, SEEK_SET);
+    for (i = 0; i < ringslots; ++i)
+	free(slots[i].mem);
+    free(slots);
+}
+
+
+static void *
+writer(
+    void *arg)
+{
+    struct slot *ps;
+    double t0;
+    int len, cnt, wrote;
+
+    while ((ps = ring_take(&diskwait)) != NULL) {
+
+	/* O_DIRECT wants whole blocks; the file is trimmed at the end */
+	len = ps->len;
+	if (direct)
+	    len = (len + DIRECTALIGN - 1) & ~(DIRECTALIGN - 1);
+	t0 = now_secs();
+	for (wrote = 0; wrote < len; wrote += cnt) {
+	    if (seekable)
+		cnt = pwrite(diskfd, ps->buf + wrote, len - wrote,
+			     diskbase + ps->off + wrote);
+	    else
+		cnt = write(diskfd, ps->buf + wrote, len - wrote);
+	    if (cnt <= 0)
+		break;
+	}
+
+	pthread_mutex_lock(&lock);
+	disktime += now_secs() - t0;
+	pthread_mutex_unlock(&lock);
+	ring_release(ps, wrote < len ? (errno ? errno : EIO) : 0);
+    }
+    return(NULL);
+}
+
+
+void
+ringsink(
+    int fd)
+{
+    pthread_t *tids;
+    struct slot *ps;
+    off_t off = 0;
+    int cnt, i;
+
+    disk_open(1);
+    nthr = ringthreads;
+    if (!seekable)
+	nthr = 1;	/* a pipe has to be written in order */
+    ring_init();
+
+    tids = calloc(nthr, sizeof(pthread_t));
+    for (i = 0; i < nthr; ++i)
+	if (pthread_create(&tids[i], NULL, writer, NULL) != 0)
+	    sys_err("pthread_create");
+
+    while ((ps = ring_get(&netwait)) != NULL) {
+	/* fill whole buffers so the writes stay block sized */
+	ps->len = 0;
+	do {
+	    cnt = Nread(fd, ps->buf + ps->len, buflen - ps->len);
+	    if (cnt > 0)
+		ps->len += cnt;
+	} while (cnt > 0 && !udp && ps->len < buflen);
+	if (ps->len == 0)
+	    break;
+	ps->off = off;
+	off += ps->len;
+	nbytes += ps->len;
+	ring_put(ps);
+	if (cnt <= 0)
+	    break;
+    }
+
+    ring_finish();
+    for (i = 0; i < nthr; ++i)
+	pthread_join(tids[i], NULL);
+    free(tids);
+
+    disk_close(off);
+    if (failed) {
+	errno = failed;
+	sys_err("ring write");
+    }
+}
+
+
+static void *
+reader(
+    void *arg)
+{
+    struct slot *ps;
+    off_t off = 0;
+    double t0;
+    int cnt;
+
+    while ((ps = ring_get(&diskwait)) != NULL) {
+	t0 = now_secs();
+	ps->len = 0;
+	do {
+	    cnt = read(diskfd, ps->buf + ps->len, buflen - ps->len);
+	    if (cnt > 0)
+		ps->len += cnt;
+	} while (cnt > 0 && ps->len < buflen);
+	disktime += now_secs() - t0;
+	if (cnt < 0) {
+	    pthread_mutex_lock(&lock);
+	    if (!failed)
+		failed = errno;
+	    pthread_cond_broadcast(&filled);
+	    pthread_mutex_unlock(&lock);
+	    break;
+	}
+	if (ps->len == 0)
+	    break;
+	ps->off = off;
+	off += ps->len;
+	ring_put(ps);
+	if (ps->len < buflen)
+	    break;		/* a short read is the end of a file */
+    }
+    ring_finish();
+    return(NULL);
+}
+
+
+void
+ringsource(
+    int fd)
+{
+    pthread_t tid;
+    struct slot *ps;
+    off_t off = 0;
+    int cnt;
+
+    disk_open(0);
+    nthr = 1;
+    ring_init();
+    if (pthread_create(&tid, NULL, reader, NULL) != 0)
+	sys_err("pthread_create");
+
+    while ((ps = ring_take(&netwait)) != NULL) {
+	cnt = Nwrite(fd, ps->buf, ps->len);
+	if (cnt != ps->len) {
+	    ring_release(ps, errno ? errno : EIO);
+	    break;
+	}
+	off += cnt;
+	nbytes += cnt;
+	ring_release(ps, 0);
+    }
+    pthread_join(tid, NULL);
+
+    disk_close(off);
+    if (failed) {
+	errno = failed;
+	sys_err("ring");
+    }
+}
+
+
+/* stdout has the data on it, so this goes to stderr */
+void
+ringreport(void)
+{
+    fprintf(stderr,
+	    "ttcp%s: ring %d x %d%s, %lu buffers, occupancy avg %.1f max %d, full %lu times\n",
+	    trans ? "-t" : "-r", ringslots, buflen,
+	    direct ? " O_DIRECT" : "",
+	    queued, queued ? (double)occsum / queued : 0.0, occmax,
+	    fullwaits);
+    fprintf(stderr,
+	    "ttcp%s: ring stalls: network %.3f sec waiting on disk, disk %.3f sec waiting on network (%d thread%s, %.3f sec %s)\n",
+	    trans ? "-t" : "-r", netwait, diskwait,
+	    nthr, nthr == 1 ? "" : "s", disktime,
+	    trans ? "reading" : "writing");
+}
@@ -0,0 +1,3 @@
+void ringsink(int fd);
+void ringsource(int fd);
+void ringreport(void);
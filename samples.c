@@ -0,0 +1,220 @@
+/*
+ * samples.c - collect measurements and summarize their distribution
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "samples.h"
+
+
+void
+samples_init(
+    struct samples *ps)
+{
+    memset(ps, 0, sizeof(*ps));
+}
+
+
+void
+samples_add(
+    struct samples *ps,
+    double val)
+{
+    if (ps->n == ps->max) {
+	ps->max = ps->max ? ps->max * 2 : 1024;
+	if ((ps->v = realloc(ps->v, ps->max * sizeof(double))) == NULL) {
+	    perror("samples_add: realloc");
+	    exit(1);
+	}
+    }
+    ps->v[ps->n++] = val;
+    ps->sorted = 0;
+}
+
+
+/* append all of src to dst */
+void
+samples_merge(
+    struct samples *pdst,
+    struct samples *psrc)
+{
+    int i;
+
+    for (i=0; i < psrc->n; ++i)
+	samples_add(pdst, psrc->v[i]);
+}
+
+
+void
+samples_free(
+    struct samples *ps)
+{
+    free(ps->v);
+    samples_init(ps);
+}
+
+
+static int
+dblcmp(
+    const void *pa,
+    const void *pb)
+{
+    double a = *(const double *)pa;
+    double b = *(const double *)pb;
+
+    return((a > b) - (a < b));
+}
+
+
+/* value below which pct percent of the samples fall (nearest rank) */
+double
+samples_pct(
+    struct samples *ps,
+    double pct)
+{
+    int ix;
+
+    if (ps->n == 0)
+	return(0.0);
+
+    if (!ps->sorted) {
+	qsort(ps->v, ps->n, sizeof(double), dblcmp);
+	ps->sorted = 1;
+    }
+
+    ix = (int) ceil(pct / 100.0 * ps->n) - 1;
+    if (ix < 0)
+	ix = 0;
+    if (ix >= ps->n)
+	ix = ps->n - 1;
+
+    return(ps->v[ix]);
+}
+
+
+double
+samples_mean(
+    struct samples *ps)
+{
+    double sum = 0.0;
+    int i;
+
+    if (ps->n == 0)
+	return(0.0);
+
+    for (i=0; i < ps->n; ++i)
+	sum += ps->v[i];
+
+    return(sum / ps->n);
+}
+
+
+/* sample standard deviation */
+double
+samples_stddev(
+    struct samples *ps)
+{
+    double mean = samples_mean(ps);
+    double sum = 0.0;
+    int i;
+
+    if (ps->n < 2)
+	return(0.0);
+
+    for (i=0; i < ps->n; ++i)
+	sum += (ps->v[i] - mean) * (ps->v[i] - mean);
+
+    return(sqrt(sum / (ps->n - 1)));
+}
+
+
+double
+samples_median(
+    struct samples *ps)
+{
+    if (ps->n == 0)
+	return(0.0);
+
+    (void) samples_pct(ps, 50.0);	/* sorts */
+    if (ps->n % 2)
+	return(ps->v[ps->n / 2]);
+    return((ps->v[ps->n/2 - 1] + ps->v[ps->n/2]) / 2.0);
+}
+
+
+double
+t975(
+    double df)
+{
+    static double table[] = {
+	0.0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+	2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110,
+	2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056,
+	2.052, 2.048, 2.045, 2.042 };
+
+    if (df < 1.0)
+	return(table[1]);
+    if (df <= 30.0)
+	return(table[(int) floor(df)]);
+    if (df <= 40.0)
+	return(2.021);
+    if (df <= 60.0)
+	return(2.000);
+    if (df <= 120.0)
+	return(1.980);
+    return(1.960);
+}
+
+
+double
+samples_ci95(
+    struct samples *ps)
+{
+    if (ps->n < 2)
+	return(0.0);
+
+    return(t975(ps->n - 1) * samples_stddev(ps) / sqrt(ps->n));
+}
+
+
+double
+samples_welch(
+    struct samples *pa,
+    struct samples *pb,
+    double *pdf)
+{
+    double va, vb, se2;
+
+    *pdf = 0.0;
+    if (pa->n < 2 || pb->n < 2)
+	return(0.0);
+
+    va = samples_stddev(pa) * samples_stddev(pa) / pa->n;
+    vb = samples_stddev(pb) * samples_stddev(pb) / pb->n;
+    se2 = va + vb;
+    if (se2 == 0.0)
+	return(0.0);
+
+    /* Welch-Satterthwaite degrees of freedom */
+    *pdf = se2 * se2 /
+	(va * va / (pa->n - 1) + vb * vb / (pb->n - 1));
+
+    return((samples_mean(pa) - samples_mean(pb)) / sqrt(se2));
+}
+
+
+char *
+samples_format(
+    struct samples *ps)
+{
+    static char buf[160];
+
+    sprintf(buf, "min=%.1f p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f",
+	    samples_pct(ps, 0.0), samples_pct(ps, 50.0),
+	    samples_pct(ps, 90.0), samples_pct(ps, 99.0),
+	    samples_pct(ps, 99.9), samples_pct(ps, 100.0));
+
+    return(buf);
+}
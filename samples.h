@@ -0,0 +1,32 @@
+/* routines for collecting and summarizing sets of measurements */
+
+struct samples {
+    double *v;			/* the values */
+    int n;			/* how many are in use */
+    int max;			/* how many are allocated */
+    int sorted;			/* v[] is in ascending order */
+};
+
+/* adding values */
+void samples_init(struct samples *ps);
+void samples_add(struct samples *ps, double val);
+void samples_merge(struct samples *pdst, struct samples *psrc);
+void samples_free(struct samples *ps);
+
+/* summaries (sorting as needed) */
+double samples_pct(struct samples *ps, double pct);
+double samples_mean(struct samples *ps);
+double samples_stddev(struct samples *ps);
+double samples_median(struct samples *ps);
+
+/* half width of the 95% confidence interval of the mean */
+double samples_ci95(struct samples *ps);
+
+/* Welch's t test of mean(a) - mean(b), returns t and sets *pdf */
+double samples_welch(struct samples *pa, struct samples *pb, double *pdf);
+
+/* two sided 95% critical value of Student's t with df degrees of freedom */
+double t975(double df);
+
+/* one line "min=.. p50=.. p90=.. p99=.. p99.9=.. max=.." summary */
+char *samples_format(struct samples *ps);
@@ -0,0 +1,368 @@
+/*
+ * stats.c - live statistics for long running tests (-E)
+ *
+ * A thread wakes up every interval, takes a snapshot of the byte and
+ * call counters, the CPU used so far and (for TCP) the socket's
+ * TCP_INFO, and either rewrites a stats file or hangs on to it for
+ * whoever connects next.  The endpoint is one of
+ *
+ *	http:PORT	HTTP on 127.0.0.1:PORT
+ *	unix:PATH	the same over an AF_UNIX socket
+ *	file:PATH	PATH rewritten (via rename) every interval
+ *
+ * optionally followed by ",SECS" for the interval (default 1).  The
+ * text is in the Prometheus exposition format either way.  The I/O
+ * loops aren't touched; the counters are just read as they go by.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "stats.h"
+
+extern int trans;
+extern int udp;
+extern int domain;
+extern unsigned long nbytes;
+extern unsigned long numCalls;
+
+extern int one;
+
+void sys_err(char *s);
+
+#define EP_HTTP	1
+#define EP_UNIX	2
+#define EP_FILE	3
+
+static int eptype;
+static char *eppath;		/* unix socket or stats file */
+static int epport;
+static int interval = 1;	/* seconds between snapshots */
+static int lfd = -1;		/* listening socket for http/unix */
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int sockfd = -1;		/* data socket of the current run */
+static int runs;		/* runs finished */
+static unsigned long donebytes;	/* bytes and calls in finished runs */
+static unsigned long donecalls;
+
+static pthread_mutex_t pagelock = PTHREAD_MUTEX_INITIALIZER;
+static char page[8192];		/* the latest snapshot */
+static int pagelen;
+
+
+static double
+now_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+
+static void
+metric(
+    char **pp,
+    char *name,
+    char *type,
+    char *help,
+    double val)
+{
+    char *end = page + sizeof(page);
+
+    *pp += snprintf(*pp, end - *pp,
+		    "# HELP ttcp_%s %s\n# TYPE ttcp_%s %s\nttcp_%s{role=\"%s\"} %.15g\n",
+		    name, help, name, type, name, trans ? "t" : "r", val);
+    if (*pp > end)
+	*pp = end;
+}
+
+
+/* build a new page from the counters */
+static void
+snapshot(void)
+{
+    static double lasttime, lastcpu;
+    static unsigned long lastbytes, lastcalls;
+    struct rusage ru;
+    double t, cpu, dt;
+    unsigned long bytes, calls;
+    char *p = page;
+    int s, n;
+
+    t = now_secs();
+    getrusage(RUSAGE_SELF, &ru);
+    cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+	ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+
+    pthread_mutex_lock(&lock);
+    bytes = __atomic_load_n(&nbytes, __ATOMIC_RELAXED);
+    calls = __atomic_load_n(&numCalls, __ATOMIC_RELAXED);
+    s = sockfd;
+    n = runs;
+
+    /* rates over the last interval; a new run resets the counters */
+    dt = (lasttime > 0.0) ? t - lasttime : 0.0;
+    if (bytes < lastbytes || calls < lastcalls)
+	lastbytes = lastcalls = 0;
+
+    metric(&p, "runs_completed", "counter", "Runs finished so far.", n);
+    metric(&p, "bytes", "gauge", "Bytes moved in the current run.", bytes);
+    metric(&p, "bytes_total", "counter", "Bytes moved in all runs.",
+	   donebytes + (s >= 0 ? bytes : 0));
+    metric(&p, "io_calls", "gauge", "I/O calls in the current run.", calls);
+    metric(&p, "io_calls_total", "counter", "I/O calls in all runs.",
+	   donecalls + (s >= 0 ? calls : 0));
+
+    metric(&p, "bytes_per_second", "gauge",
+	   "Bytes per second over the last interval.",
+	   dt > 0.0 ? (bytes - lastbytes) / dt : 0.0);
+    metric(&p, "io_calls_per_second", "gauge",
+	   "I/O calls per second over the last interval.",
+	   dt > 0.0 ? (calls - lastcalls) / dt : 0.0);
+    metric(&p, "cpu_user_seconds_total", "counter", "User CPU seconds.",
+	   ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6);
+    metric(&p, "cpu_system_seconds_total", "counter", "System CPU seconds.",
+	   ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6);
+    metric(&p, "cpu_utilization", "gauge",
+	   "CPU seconds per second over the last interval.",
+	   dt > 0.0 ? (cpu - lastcpu) / dt : 0.0);
+
+#ifdef TCP_INFO
+    if (s >= 0 && !udp && domain == AF_INET) {
+	struct tcp_info ti;
+	socklen_t len = sizeof(ti);
+
+	if (getsockopt(s, IPPROTO_TCP, TCP_INFO, &ti, &len) == 0) {
+	    metric(&p, "tcp_rtt_seconds", "gauge", "Smoothed RTT.",
+		   ti.tcpi_rtt / 1e6);
+	    metric(&p, "tcp_rttvar_seconds", "gauge", "RTT variation.",
+		   ti.tcpi_rttvar / 1e6);
+	    metric(&p, "tcp_snd_cwnd", "gauge", "Congestion window, segments.",
+		   ti.tcpi_snd_cwnd);
+	    metric(&p, "tcp_snd_mss", "gauge", "Sender MSS.",
+		   ti.tcpi_snd_mss);
+	    metric(&p, "tcp_unacked", "gauge", "Segments not yet acked.",
+		   ti.tcpi_unacked);
+	    metric(&p, "tcp_lost", "gauge", "Segments thought lost.",
+		   ti.tcpi_lost);
+	    metric(&p, "tcp_retrans_total", "counter",
+		   "Segments retransmitted on this connection.",
+		   ti.tcpi_total_retrans);
+	}
+    }
+#endif
+    /* held until here so the socket can't be closed under getsockopt() */
+    pthread_mutex_unlock(&lock);
+
+    lasttime = t;
+    lastcpu = cpu;
+    lastbytes = bytes;
+    lastcalls = calls;
+    pagelen = p - page;
+}
+
+
+static void
+writefile(void)
+{
+    char tmp[1024];
+    int wfd;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", eppath);
+    if ((wfd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0)
+	return;
+    if (write(wfd, page, pagelen) == pagelen)
+	(void)rename(tmp, eppath);
+    close(wfd);
+}
+
+
+/*
+ * answer one scraper with text, a copy of the page; HTTP if it asked
+ * with a GET, raw text otherwise
+ */
+static void
+answer(
+    int cfd,
+    char *text,
+    int len)
+{
+    struct timeval tv = { 0, 200000 };
+    struct pollfd pfd;
+    char req[1024];
+    char hdr[256];
+    int n = 0, hlen;
+
+    /* nor hold up the snapshots for long */
+    (void)setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    pfd.fd = cfd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 200) == 1)
+	n = read(cfd, req, sizeof(req) - 1);
+    if (n >= 3 && strncmp(req, "GET", 3) == 0) {
+	hlen = snprintf(hdr, sizeof(hdr),
+			"HTTP/1.0 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: %d\r\n"
+			"Connection: close\r\n\r\n", len);
+	if (write(cfd, hdr, hlen) != hlen) {
+	    close(cfd);
+	    return;
+	}
+    }
+    if (write(cfd, text, len) != len)
+	;			/* they went away, nothing to be done */
+    close(cfd);
+}
+
+
+static void *
+statsthread(
+    void *arg)
+{
+    static char copy[sizeof(page)];
+    struct pollfd pfd;
+    double next = now_secs();
+    int ms, cfd, len;
+
+    while (1) {
+	if (now_secs() >= next) {
+	    pthread_mutex_lock(&pagelock);
+	    snapshot();
+	    if (eptype == EP_FILE)
+		writefile();
+	    pthread_mutex_unlock(&pagelock);
+	    next += interval;
+	}
+	ms = (next - now_secs()) * 1000;
+	if (ms < 0)
+	    ms = 0;
+	if (lfd < 0) {
+	    poll(NULL, 0, ms);
+	    continue;
+	}
+	pfd.fd = lfd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, ms) == 1 && (cfd = accept(lfd, NULL, NULL)) >= 0) {
+	    /* a slow scraper mustn't hold up the next snapshot */
+	    pthread_mutex_lock(&pagelock);
+	    memcpy(copy, page, pagelen);
+	    len = pagelen;
+	    pthread_mutex_unlock(&pagelock);
+	    answer(cfd, copy, len);
+	}
+    }
+    return(NULL);
+}
+
+
+static void
+stats_unlink(void)
+{
+    (void)unlink(eppath);
+}
+
+
+void
+stats_start(
+    char *spec)
+{
+    pthread_t tid;
+    char *comma;
+
+    if ((comma = strchr(spec, ',')) != NULL) {
+	*comma = '\0';
+	if ((interval = atoi(comma + 1)) <= 0)
+	    interval = 1;
+    }
+    if (strncmp(spec, "http:", 5) == 0) {
+	struct sockaddr_in sin;
+
+	eptype = EP_HTTP;
+	epport = atoi(spec + 5);
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(epport);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+	    sys_err("stats socket");
+	(void)setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(lfd, (struct sockaddr *)&sin, sizeof(sin)) < 0)
+	    sys_err("stats bind");
+    } else if (strncmp(spec, "unix:", 5) == 0) {
+	struct sockaddr_un sun;
+
+	eptype = EP_UNIX;
+	eppath = spec + 5;
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strncpy(sun.sun_path, eppath, sizeof(sun.sun_path) - 1);
+	(void)unlink(eppath);
+	if ((lfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+	    sys_err("stats socket");
+	if (bind(lfd, (struct sockaddr *)&sun, sizeof(sun)) < 0)
+	    sys_err("stats bind");
+	atexit(stats_unlink);
+    } else if (strncmp(spec, "file:", 5) == 0) {
+	eptype = EP_FILE;
+	eppath = spec + 5;
+    } else {
+	fprintf(stderr, "ttcp: -E wants http:PORT, unix:PATH or file:PATH\n");
+	exit(1);
+    }
+    if (lfd >= 0 && listen(lfd, 8) < 0)
+	sys_err("stats listen");
+
+    snapshot();
+    if (pthread_create(&tid, NULL, statsthread, NULL) != 0)
+	sys_err("pthread_create");
+    pthread_detach(tid);
+}
+
+
+/* the data socket for this run is up */
+void
+stats_run(
+    int fd)
+{
+    pthread_mutex_lock(&lock);
+    sockfd = fd;
+    pthread_mutex_unlock(&lock);
+}
+
+
+/* this run is over, before its socket is closed */
+void
+stats_runend(void)
+{
+    pthread_mutex_lock(&lock);
+    sockfd = -1;
+    donebytes += nbytes;
+    donecalls += numCalls;
+    ++runs;
+    pthread_mutex_unlock(&lock);
+    if (eptype == EP_FILE) {
+	/* don't make them wait for the next interval to see the end */
+	pthread_mutex_lock(&pagelock);
+	snapshot();
+	writefile();
+	pthread_mutex_unlock(&pagelock);
+    }
+}
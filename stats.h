@@ -0,0 +1,3 @@
+void stats_start(char *spec);
+void stats_run(int fd);
+void stats_runend(void);
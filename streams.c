@@ -0,0 +1,129 @@
+/*
+ * streams.c - run sink mode streams in forked children
+ *
+ * The child inherits whatever settings the parent has put in the
+ * globals (algorithm, buffer sizes, ...), connects, transfers, and
+ * sends its results back up a pipe.  Running each stream in its own
+ * process lets the parent read the CPU it cost with wait4().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "streams.h"
+#include "ktls.h"
+
+extern int fd;
+extern int ktls;
+extern unsigned long nbytes;
+extern double cput, realt;
+
+void sys_err(char *s);
+void netsetup(void);
+void transfer(void);
+double read_timer(char *str, int len);
+
+
+/* run the stream in the child, sending the results up the pipe */
+static void
+stream_child(
+    int wfd)
+{
+    struct stream res;
+    char stats[128];
+
+    memset(&res, 0, sizeof(res));
+    netsetup();
+    if (ktls)
+	ktls_setup(fd);
+    transfer();
+#ifdef TCP_INFO
+    {
+	struct tcp_info ti;
+	socklen_t len = sizeof(ti);
+
+	if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) == 0) {
+	    res.retrans = ti.tcpi_total_retrans;
+	    res.rtt = ti.tcpi_rtt;
+	    res.rttvar = ti.tcpi_rttvar;
+	}
+    }
+#endif
+    {
+	socklen_t len = sizeof(res.sndbuf);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &res.sndbuf, &len) < 0)
+	    res.sndbuf = 0;
+    }
+    close(fd);			/* lingers until the data is delivered */
+    (void)read_timer(stats, sizeof(stats));
+    res.bytes = nbytes;
+    res.realt = realt > 0.0 ? realt : 0.001;
+    if (write(wfd, &res, sizeof(res)) != sizeof(res))
+	sys_err("write: results");
+    exit(0);
+}
+
+
+void
+stream_start(
+    struct stream *ps)
+{
+    int pfd[2];
+
+    memset(ps, 0, sizeof(*ps));
+    if (pipe(pfd) < 0)
+	sys_err("pipe");
+    fflush(stdout);
+    if ((ps->pid = fork()) < 0)
+	sys_err("fork");
+    if (ps->pid == 0) {
+	close(pfd[0]);
+	stream_child(pfd[1]);
+    }
+    close(pfd[1]);
+    ps->rfd = pfd[0];
+}
+
+
+struct stream *
+stream_reap(
+    struct stream *streams,
+    int n)
+{
+    struct stream res;
+    struct stream *ps;
+    struct rusage ru;
+    int status;
+    pid_t pid;
+    int i;
+
+    while ((pid = wait4(-1, &status, 0, &ru)) > 0) {
+	for (i=0; i < n; ++i) {
+	    ps = &streams[i];
+	    if (ps->pid != pid)
+		continue;
+	    if (WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+		read(ps->rfd, &res, sizeof(res)) == sizeof(res)) {
+		res.pid = ps->pid;
+		res.rfd = ps->rfd;
+		*ps = res;
+		ps->ok = 1;
+	    }
+	    close(ps->rfd);
+	    ps->cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+		ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+	    return(ps);
+	}
+    }
+
+    return(NULL);
+}
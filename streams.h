@@ -0,0 +1,20 @@
+/* sink mode streams run in forked children, for comparisons and sweeps */
+
+struct stream {
+    pid_t pid;			/* child running the stream */
+    int rfd;			/* read end of its result pipe */
+    int ok;			/* child finished and reported */
+    unsigned long bytes;	/* moved by the stream */
+    double realt;		/* its elapsed time */
+    double cpu;			/* user+sys of the child */
+    unsigned retrans;		/* segments retransmitted */
+    unsigned rtt;		/* smoothed RTT, usecs */
+    unsigned rttvar;		/* and its variation */
+    int sndbuf;			/* SO_SNDBUF at the end, as the kernel sees it */
+};
+
+/* fork a child to run one transfer with the current settings */
+void stream_start(struct stream *ps);
+
+/* wait for any one of the n streams to finish, NULL if none left */
+struct stream *stream_reap(struct stream *streams, int n);
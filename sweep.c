@@ -0,0 +1,250 @@
+/*
+ * sweep.c - sweep buffer length, socket buffer size, TCP_NODELAY and
+ *	     the number of concurrent streams (-X) against one receiver
+ *
+ * Each -X names one dimension and its values, either a list
+ * "1024,4096,65536" or a doubling range "1k..64k".  Every combination
+ * is run as -j sink mode streams to a receiver started with -k 0,
+ * then the best point and where throughput levels off are reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include "streams.h"
+#include "units.h"
+#include "sweep.h"
+
+extern int buflen;
+extern int sockbufsize;
+extern int nodelay;
+extern int nthreads;
+
+char *outfmt(double b);
+
+#define MAXVALS   32		/* per dimension */
+#define MAXPOINTS 4096		/* in the whole sweep */
+#define PLATEAU   0.95		/* "leveled off" means within 5% of best */
+
+static struct dim {
+    char *name;			/* -X name= */
+    char *label;		/* for the table */
+    int *pvar;			/* the setting it varies */
+    int vals[MAXVALS];
+    int nvals;
+} dims[] = {
+    { "l", "buflen", &buflen },
+    { "b", "sockbuf", &sockbufsize },
+    { "D", "nodelay", &nodelay },
+    { "j", "streams", &nthreads },
+};
+#define NDIMS (sizeof(dims)/sizeof(dims[0]))
+
+static double tput[MAXPOINTS];	/* bytes/sec at each point */
+
+
+/* a number with an optional k or m suffix */
+static int
+sweepnum(
+    char *str,
+    char **pend)
+{
+    long val = strtol(str, pend, 0);
+
+    if (**pend == 'k' || **pend == 'K')
+	val *= 1024, ++*pend;
+    else if (**pend == 'm' || **pend == 'M')
+	val *= 1024*1024, ++*pend;
+
+    return((int) val);
+}
+
+
+static void
+sweepbad(
+    char *spec)
+{
+    fprintf(stderr,
+	    "ttcp: bad -X %s, expected {l,b,D,j}=N,N,... or {l,b,D,j}=LO..HI\n",
+	    spec);
+    exit(1);
+}
+
+
+void
+sweepopt(
+    char *spec)
+{
+    struct dim *pd = NULL;
+    char *cp;
+    int lo, hi;
+    int i;
+
+    for (i=0; i < NDIMS; ++i) {
+	if (strncmp(spec, dims[i].name, strlen(dims[i].name)) == 0 &&
+	    spec[strlen(dims[i].name)] == '=')
+	    pd = &dims[i];
+    }
+    if (pd == NULL)
+	sweepbad(spec);
+    cp = spec + strlen(pd->name) + 1;
+    pd->nvals = 0;
+
+    lo = sweepnum(cp, &cp);
+    if (strncmp(cp, "..", 2) == 0) {
+	/* doubling range */
+	hi = sweepnum(cp + 2, &cp);
+	if (*cp != '\0' || lo < 0 || hi < lo)
+	    sweepbad(spec);
+	do {
+	    if (pd->nvals == MAXVALS)
+		sweepbad(spec);
+	    pd->vals[pd->nvals++] = lo;
+	    lo = lo ? lo * 2 : 1;
+	} while (lo <= hi);
+	return;
+    }
+
+    /* list */
+    while (1) {
+	if (pd->nvals == MAXVALS || lo < 0)
+	    sweepbad(spec);
+	pd->vals[pd->nvals++] = lo;
+	if (*cp == '\0')
+	    break;
+	if (*cp != ',')
+	    sweepbad(spec);
+	lo = sweepnum(cp + 1, &cp);
+    }
+}
+
+
+/* the largest buffer the sweep will need */
+int
+sweepbuflen(void)
+{
+    int max = buflen;
+    int i;
+
+    for (i=0; i < dims[0].nvals; ++i)
+	if (dims[0].vals[i] > max)
+	    max = dims[0].vals[i];
+
+    return(max);
+}
+
+
+/* set the globals for point n, returning the index into each dim */
+static void
+sweeppoint(
+    int n,
+    int ix[])
+{
+    int i;
+
+    for (i=NDIMS-1; i >= 0; --i) {
+	ix[i] = n % dims[i].nvals;
+	n /= dims[i].nvals;
+	*dims[i].pvar = dims[i].vals[ix[i]];
+    }
+}
+
+
+/* point number for the given indices */
+static int
+sweepindex(
+    int ix[])
+{
+    int n = 0;
+    int i;
+
+    for (i=0; i < NDIMS; ++i)
+	n = n * dims[i].nvals + ix[i];
+
+    return(n);
+}
+
+
+void
+sweep(void)
+{
+    struct stream streams[256];
+    int ix[NDIMS], bestix[NDIMS];
+    unsigned long bytes;
+    double longest, cpu;
+    int npoints = 1;
+    int best = 0;
+    int n, i, s;
+
+    for (i=0; i < NDIMS; ++i) {
+	if (dims[i].nvals == 0) {
+	    /* not swept, stick with the command line value */
+	    dims[i].vals[0] = *dims[i].pvar;
+	    dims[i].nvals = 1;
+	}
+	npoints *= dims[i].nvals;
+    }
+    for (i=0; i < dims[3].nvals; ++i) {
+	if (dims[3].vals[i] < 1 ||
+	    dims[3].vals[i] > sizeof(streams)/sizeof(streams[0])) {
+	    fprintf(stderr, "ttcp-t: -X j= must be 1..%d\n",
+		    (int)(sizeof(streams)/sizeof(streams[0])));
+	    exit(1);
+	}
+    }
+    if (npoints > MAXPOINTS) {
+	fprintf(stderr, "ttcp-t: %d sweep points, at most %d\n",
+		npoints, MAXPOINTS);
+	exit(1);
+    }
+
+    fprintf(stdout, "ttcp-t: sweep of %d points\n", npoints);
+    fprintf(stdout, "ttcp-t:   %8s %8s %8s %8s %18s %8s\n",
+	    dims[0].label, dims[1].label, dims[2].label, dims[3].label,
+	    "throughput", "cpu/GB");
+    for (n=0; n < npoints; ++n) {
+	sweeppoint(n, ix);
+	for (s=0; s < nthreads; ++s)
+	    stream_start(&streams[s]);
+	for (s=0; s < nthreads; ++s)
+	    (void)stream_reap(streams, nthreads);
+
+	bytes = 0;
+	longest = cpu = 0.0;
+	for (s=0; s < nthreads; ++s) {
+	    if (!streams[s].ok)
+		continue;
+	    bytes += streams[s].bytes;
+	    cpu += streams[s].cpu;
+	    if (streams[s].realt > longest)
+		longest = streams[s].realt;
+	}
+	tput[n] = longest > 0.0 ? bytes / longest : 0.0;
+	if (tput[n] > tput[best])
+	    best = n;
+
+	fprintf(stdout, "ttcp-t:   %8d %8d %8d %8d %13s/sec %8.2f\n",
+		buflen, sockbufsize, nodelay, nthreads, outfmt(tput[n]),
+		bytes ? cpu * GIGABYTE / bytes : 0.0);
+	fflush(stdout);
+    }
+
+    sweeppoint(best, bestix);
+    fprintf(stdout, "ttcp-t: best: buflen=%d, sockbufsize=%d, nodelay=%d, streams=%d  %s/sec\n",
+	    buflen, sockbufsize, nodelay, nthreads, outfmt(tput[best]));
+
+    /* holding the rest at the best point, where does each level off? */
+    for (i=0; i < NDIMS; ++i) {
+	if (dims[i].nvals < 2)
+	    continue;
+	memcpy(ix, bestix, sizeof(ix));
+	for (ix[i]=0; ix[i] < dims[i].nvals; ++ix[i]) {
+	    if (tput[sweepindex(ix)] >= PLATEAU * tput[best])
+		break;
+	}
+	fprintf(stdout, "ttcp-t: plateau: %s reaches %.0f%% of best at %d\n",
+		dims[i].label, PLATEAU * 100, dims[i].vals[ix[i]]);
+    }
+}
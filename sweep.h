@@ -0,0 +1,3 @@
+void sweepopt(char *spec);
+int sweepbuflen(void);
+void sweep(void);
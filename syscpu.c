@@ -0,0 +1,434 @@
+/*
+ * syscpu.c - system wide CPU use over the timed part (-I)
+ *
+ * getrusage() only sees this process, but on a receiver much of the
+ * cost of the network lands in softirq context, often on other cores
+ * and in ksoftirqd.  Here /proc/stat is read for every CPU when the
+ * timer starts and stops (and every -I seconds in between, if asked)
+ * and the user, system, irq and softirq time of the whole machine is
+ * put next to the process's own, per gigabyte moved.  With -v the
+ * /proc/softirqs and /proc/interrupts counts that moved are shown too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "units.h"
+#include "syscpu.h"
+
+extern int trans;
+extern int verbose;
+extern int cpuinterval;		/* secs between samples, 0 = none */
+extern unsigned long nbytes;
+extern double cput, realt;
+
+void sys_err(char *s);
+
+#define MAXCPU	 1024
+#define MAXNAMED 1024
+
+/* columns of the cpu lines in /proc/stat */
+#define F_USER	  0
+#define F_NICE	  1
+#define F_SYSTEM  2
+#define F_IDLE	  3
+#define F_IOWAIT  4
+#define F_IRQ	  5
+#define F_SOFTIRQ 6
+#define F_STEAL	  7
+#define NF	  8
+
+struct named {
+    char name[48];
+    unsigned long long count;
+};
+
+struct snap {
+    double t;
+    int ncpu;
+    unsigned long long cpu[MAXCPU][NF];
+    int nsoft;
+    struct named soft[32];
+    int nintr;
+    struct named intr[MAXNAMED];
+};
+
+static struct snap s0, s1, si;	/* start, end, last interval */
+static long hz;
+
+static pthread_t sampler;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake;
+static int running, stopping;
+
+
+static double
+now_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+
+/* read "name: n n n ... [description]" tables, summing the counts */
+static int
+readtable(
+    char *path,
+    struct named *tab,
+    int max)
+{
+    char line[4096];
+    char *p, *name, *end;
+    FILE *f;
+    int n = 0;
+    unsigned long long v;
+
+    if ((f = fopen(path, "r")) == NULL)
+	return(0);
+    (void)fgets(line, sizeof(line), f);	/* the CPUn header */
+    while (n < max && fgets(line, sizeof(line), f) != NULL) {
+	for (name = line; isspace((unsigned char)*name); ++name)
+	    ;
+	if ((p = strchr(name, ':')) == NULL)
+	    continue;
+	*p++ = '\0';
+	tab[n].count = 0;
+	while (1) {
+	    v = strtoull(p, &end, 10);
+	    if (end == p)
+		break;
+	    tab[n].count += v;
+	    p = end;
+	}
+	/* interrupts have a description after the counts */
+	while (isspace((unsigned char)*p))
+	    ++p;
+	if ((end = strchr(p, '\n')) != NULL)
+	    *end = '\0';
+	if (*p)
+	    snprintf(tab[n].name, sizeof(tab[n].name), "%.8s %.38s", name, p);
+	else
+	    snprintf(tab[n].name, sizeof(tab[n].name), "%.47s", name);
+	++n;
+    }
+    fclose(f);
+    return(n);
+}
+
+
+static void
+snapshot(
+    struct snap *ps)
+{
+    char line[1024];
+    FILE *f;
+    int cpu, i;
+    char *p, *end;
+
+    ps->t = now_secs();
+    ps->ncpu = 0;
+    if ((f = fopen("/proc/stat", "r")) == NULL)
+	sys_err("/proc/stat");
+    while (fgets(line, sizeof(line), f) != NULL) {
+	if (strncmp(line, "cpu", 3) != 0 || !isdigit((unsigned char)line[3]))
+	    continue;
+	cpu = strtol(line + 3, &p, 10);
+	if (cpu >= MAXCPU)
+	    continue;
+	for (i = 0; i < NF; ++i) {
+	    ps->cpu[cpu][i] = strtoull(p, &end, 10);
+	    p = end;
+	}
+	if (cpu >= ps->ncpu)
+	    ps->ncpu = cpu + 1;
+    }
+    fclose(f);
+
+    if (verbose) {
+	ps->nsoft = readtable("/proc/softirqs", ps->soft, 32);
+	ps->nintr = readtable("/proc/interrupts", ps->intr, MAXNAMED);
+    }
+}
+
+
+/* seconds of each kind between two snapshots, summed over the CPUs */
+static void
+cpusecs(
+    struct snap *pa,
+    struct snap *pb,
+    int cpu,			/* -1 for all of them */
+    double *secs)
+{
+    int c, i;
+
+    for (i = 0; i < NF; ++i)
+	secs[i] = 0.0;
+    for (c = 0; c < pb->ncpu; ++c) {
+	if (cpu >= 0 && c != cpu)
+	    continue;
+	for (i = 0; i < NF; ++i)
+	    secs[i] += (double)(pb->cpu[c][i] - pa->cpu[c][i]) / hz;
+    }
+}
+
+
+static double
+busy(
+    double *secs)
+{
+    return(secs[F_USER] + secs[F_NICE] + secs[F_SYSTEM] +
+	   secs[F_IRQ] + secs[F_SOFTIRQ] + secs[F_STEAL]);
+}
+
+
+/* the busiest CPU between two snapshots, and how busy */
+static int
+busiest(
+    struct snap *pa,
+    struct snap *pb,
+    int skip1,
+    int skip2,
+    double *pbusy)
+{
+    double secs[NF];
+    double b, most = -1.0;
+    int c, which = -1;
+
+    for (c = 0; c < pb->ncpu; ++c) {
+	if (c == skip1 || c == skip2)
+	    continue;
+	cpusecs(pa, pb, c, secs);
+	if ((b = busy(secs)) > most) {
+	    most = b;
+	    which = c;
+	}
+    }
+    *pbusy = most;
+    return(which);
+}
+
+
+/* mid-run, stdout may have the data on it, so this goes to stderr */
+static void
+interval(void)
+{
+    struct snap *pa = &si;
+    static struct snap now;
+    double secs[NF], dt, b;
+    int c;
+
+    snapshot(&now);
+    dt = now.t - pa->t;
+    if (dt <= 0.0)
+	return;
+    cpusecs(pa, &now, -1, secs);
+    c = busiest(pa, &now, -1, -1, &b);
+    fprintf(stderr,
+	    "ttcp%s: cpu +%.1fs: usr %.0f%% sys %.0f%% softirq %.0f%% irq %.0f%% of %d cpus, busiest cpu%d %.0f%%\n",
+	    trans ? "-t" : "-r", now.t - s0.t,
+	    100.0 * (secs[F_USER] + secs[F_NICE]) / dt / now.ncpu,
+	    100.0 * secs[F_SYSTEM] / dt / now.ncpu,
+	    100.0 * secs[F_SOFTIRQ] / dt / now.ncpu,
+	    100.0 * secs[F_IRQ] / dt / now.ncpu,
+	    now.ncpu, c, 100.0 * b / dt);
+    memcpy(pa, &now, sizeof(now));
+}
+
+
+static void *
+samplethread(
+    void *arg)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    pthread_mutex_lock(&lock);
+    while (!stopping) {
+	deadline.tv_sec += cpuinterval;
+	while (!stopping &&
+	       pthread_cond_timedwait(&wake, &lock, &deadline) != ETIMEDOUT)
+	    ;
+	if (!stopping)
+	    interval();
+    }
+    pthread_mutex_unlock(&lock);
+    return(NULL);
+}
+
+
+static void
+stopthread(void)
+{
+    if (!running)
+	return;
+    pthread_mutex_lock(&lock);
+    stopping = 1;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(sampler, NULL);
+    pthread_cond_destroy(&wake);
+    running = 0;
+}
+
+
+/* from prep_timer(), which the UDP receiver may call twice */
+void
+syscpu_start(void)
+{
+    pthread_condattr_t attr;
+
+    stopthread();
+    if (hz == 0)
+	hz = sysconf(_SC_CLK_TCK);
+    snapshot(&s0);
+    if (cpuinterval <= 0)
+	return;
+    memcpy(&si, &s0, sizeof(s0));
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wake, &attr);
+    pthread_condattr_destroy(&attr);
+    stopping = 0;
+    if (pthread_create(&sampler, NULL, samplethread, NULL) != 0)
+	sys_err("pthread_create");
+    running = 1;
+}
+
+
+/* from read_timer() */
+void
+syscpu_stop(void)
+{
+    stopthread();
+    snapshot(&s1);
+}
+
+
+/* a guess at the clock rate, for turning seconds into cycles */
+static double
+cpumhz(void)
+{
+    char line[256];
+    double mhz = 0.0;
+    FILE *f;
+
+    if ((f = fopen("/proc/cpuinfo", "r")) == NULL)
+	return(0.0);
+    while (fgets(line, sizeof(line), f) != NULL)
+	if (strncmp(line, "cpu MHz", 7) == 0 &&
+	    sscanf(strchr(line, ':') + 1, "%lf", &mhz) == 1)
+	    break;
+    fclose(f);
+    return(mhz);
+}
+
+
+static void
+showmoved(
+    char *what,
+    struct named *pa,
+    int na,
+    struct named *pb,
+    int nb,
+    int top)
+{
+    unsigned long long d;
+    int i, j, k, shown;
+    int order[MAXNAMED];
+    unsigned long long delta[MAXNAMED];
+
+    /* the tables line up unless a device came or went */
+    for (i = 0; i < nb && i < MAXNAMED; ++i) {
+	delta[i] = 0;
+	for (j = 0; j < na; ++j)
+	    if (strcmp(pa[j].name, pb[i].name) == 0) {
+		delta[i] = pb[i].count - pa[j].count;
+		break;
+	    }
+	order[i] = i;
+    }
+    /* small tables, a selection sort is plenty */
+    for (i = 0; i < nb; ++i)
+	for (j = i + 1; j < nb; ++j)
+	    if (delta[order[j]] > delta[order[i]]) {
+		k = order[i];
+		order[i] = order[j];
+		order[j] = k;
+	    }
+    for (i = shown = 0; i < nb && shown < top; ++i) {
+	d = delta[order[i]];
+	if (d == 0)
+	    break;
+	fprintf(stdout, "ttcp%s: %s %-40s %12llu\n",
+		trans ? "-t" : "-r", what, pb[order[i]].name, d);
+	++shown;
+    }
+}
+
+
+void
+syscpu_report(void)
+{
+    double secs[NF], all, gb, mhz, b1, b2, b3;
+    int c1, c2, c3;
+    char *who = trans ? "-t" : "-r";
+
+    cpusecs(&s0, &s1, -1, secs);
+    all = busy(secs);
+    gb = nbytes / GIGABYTE;
+    if (gb <= 0.0)
+	gb = 1e-9;
+
+    fprintf(stdout,
+	    "ttcp%s: system cpu secs: usr %.2f sys %.2f softirq %.2f irq %.2f steal %.2f, total %.2f of %d cpus\n",
+	    who, secs[F_USER] + secs[F_NICE], secs[F_SYSTEM],
+	    secs[F_SOFTIRQ], secs[F_IRQ], secs[F_STEAL], all, s1.ncpu);
+    fprintf(stdout,
+	    "ttcp%s: cpu secs/GB: process %.3f, system %.3f (softirq %.3f)\n",
+	    who, cput / gb, all / gb, secs[F_SOFTIRQ] / gb);
+    if ((mhz = cpumhz()) > 0.0) {
+	double pergb = mhz * 1e6 / gb;	/* cycles/GB for each cpu second */
+
+	fprintf(stdout,
+		"ttcp%s: cycles/GB at %.0f MHz: usr %.3g sys %.3g softirq %.3g irq %.3g, total %.3g (process %.3g)\n",
+		who, mhz,
+		(secs[F_USER] + secs[F_NICE]) * pergb, secs[F_SYSTEM] * pergb,
+		secs[F_SOFTIRQ] * pergb, secs[F_IRQ] * pergb,
+		all * pergb, cput * pergb);
+    }
+
+    c1 = busiest(&s0, &s1, -1, -1, &b1);
+    c2 = busiest(&s0, &s1, c1, -1, &b2);
+    c3 = busiest(&s0, &s1, c1, c2, &b3);
+    if (realt > 0.0 && c1 >= 0) {
+	double soft[NF];
+
+	fprintf(stdout, "ttcp%s: busiest cpus:", who);
+	cpusecs(&s0, &s1, c1, soft);
+	fprintf(stdout, " cpu%d %.0f%% (softirq %.0f%%)", c1,
+		100.0 * b1 / realt, 100.0 * soft[F_SOFTIRQ] / realt);
+	if (c2 >= 0) {
+	    cpusecs(&s0, &s1, c2, soft);
+	    fprintf(stdout, ", cpu%d %.0f%% (softirq %.0f%%)", c2,
+		    100.0 * b2 / realt, 100.0 * soft[F_SOFTIRQ] / realt);
+	}
+	if (c3 >= 0) {
+	    cpusecs(&s0, &s1, c3, soft);
+	    fprintf(stdout, ", cpu%d %.0f%% (softirq %.0f%%)", c3,
+		    100.0 * b3 / realt, 100.0 * soft[F_SOFTIRQ] / realt);
+	}
+	fprintf(stdout, "\n");
+    }
+
+    if (verbose) {
+	showmoved("softirq", s0.soft, s0.nsoft, s1.soft, s1.nsoft, 10);
+	showmoved("irq", s0.intr, s0.nintr, s1.intr, s1.nintr, 5);
+    }
+}
@@ -0,0 +1,3 @@
+void syscpu_start(void);
+void syscpu_stop(void);
+void syscpu_report(void);
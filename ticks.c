@@ -10,241 +10,207 @@
  */
 
 
+/*
+ * The I/O loops only bump a couple of counters here; a reporter thread
+ * wakes up every REFRESH_MS and does the drawing, so turning on -P or
+ * -S costs the same no matter how many writes a second are going by.
+ */
+
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "timeval.h"
+#include "ticks.h"
 
 extern int speed;
 char *outfmt(double b);
+void sys_err(char *s);
 
 
+#define REFRESH_MS 250		/* how often the reporter draws */
+#define GOBACK_MS 2000		/* "recent" throughput is over this long */
+#define NHIST (GOBACK_MS / REFRESH_MS + 1)
+
+/* bumped by the I/O loops, read by the reporter */
+static atomic_ulong tickcount;
+static atomic_ulong tickbytes;
 
 float pertick;
 int currpos;
-int count;
 
 #define DEFAULT_LINELENGTH 65
 int linelength = DEFAULT_LINELENGTH;
 
-void
-inittick(int max)
-{
-/* 	int i; */
-
-	currpos = 0.0;
-	count = 0;
-
-	if (speed) linelength -= 10;/* make room for speed digits */
-	pertick = (float) max / (float)linelength;
+static pthread_t reporter;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake;
+static int running;		/* reporter thread is up */
+static int stopping;		/* tickdone() wants it gone */
+static int showbar;		/* draw the -P bar (else just -S speed) */
 
-#ifdef OLD
-	fprintf(stderr,"|");
-	for (i=0; i < LINELENGTH; ++i) fprintf(stderr,"-");
-	fprintf(stderr,"|");
-	fprintf(stderr,"%c|", '\015');
-	fflush(stderr);
-#endif
-}
-
-
-
-#ifdef SLOW_VERSION
-/*return "recent" throughput in BYTES/second */
-static float
-calc_tput(
-    int bytes)
-{
-#define GOBACK_MS 2000
-    struct sample {
-	struct timeval t;
-	unsigned nbytes;
-	struct sample *next;
-    };
-    static struct sample *samples = NULL;
-    struct sample *ps, *plast;
-    unsigned ttl = 0;
-    u_long etime_ms = 0;
-
-    /* make a new sample */
-    ps = malloc(sizeof(struct sample));
-    ps->next = NULL;
-    gettimeofday(&ps->t,NULL);
-    ps->nbytes = bytes;
-
-    /* chain it in */
-    ps->next = samples;
-    samples = ps;
-       
-    /* go back GOBACK mseconds */
-    plast = NULL;
-    for (ps=samples; ps; ) {
-	unsigned et = tv_ago_msecs(ps->t);
-	if (et <= GOBACK_MS) {
-	    ttl += ps->nbytes;
-	    etime_ms = et;
-	    plast = ps;
-	    ps = ps->next;
-	} else {
-	    struct sample *pn = ps->next;
-	    if (plast) {
-		plast->next = NULL; /* bisect the list */
-		plast = NULL;
-	    }
-	    free(ps);
-	    if (ps == samples)
-		samples = NULL; /* whole list is empty */
-	    ps = pn;
-	}
-    }
-
-    /* if no elapsed time, no work done */
-    if (etime_ms == 0) {
-	return(0.0);
-    }
-
-    return(((float) ttl)/ ((float)etime_ms / 1000));
-}
-#endif
+/* byte counts at the last NHIST refreshes, for calc_tput() */
+static struct {
+    struct timeval t;
+    unsigned long nbytes;
+} hist[NHIST];
+static int nhist;
 
 
 /*return "recent" throughput in BYTES/second */
 /*
- * modified for faster networks and slower hosts to be less compute intensive
- * 
+ * called once a refresh with the running byte count, which is kept
+ * in a small fixed ring rather than a sample per write
  */
 static float
 calc_tput(
-    int bytes)
+    unsigned long bytes)
 {
-#define GOBACK_MS 2000
-#define BUCKET_SIZE 100 /* in Milliseconds */
-    struct sample {
-	struct timeval t;
-	unsigned nbytes;
-	struct sample *next;
-    };
-    static struct sample *samples = NULL;
-    struct timeval time_now;
-    struct sample *ps, *plast;
-    unsigned ttl = 0;
-    u_long etime_ms = 0;
-
-    /* check current time, then drop digits to 100MS resolution */
-    gettimeofday(&time_now,NULL);
-    int resolution = 1000000 / BUCKET_SIZE;
-    time_now.tv_usec /= resolution;
-    time_now.tv_usec *= resolution;
-
-    /* if new sample goes in the same bucket, just add it in, otherwise make a new one */
-    /* this saves a lot of work on really fast networks and the slight cost of granularity accuracy */
-    if (samples && (tv_cmp(time_now,samples->t)==0)) {
-	/* add to first sample */
-	ps = samples;
-	ps->nbytes += bytes;
-
-    } else {
-	/* make a new sample */
-	ps = malloc(sizeof(struct sample));
-	ps->next = NULL;
-	ps->t = time_now;
-	ps->nbytes = bytes;
-
-	/* chain it in */
-	ps->next = samples;
-	samples = ps;
-    }
-       
-    /* go back GOBACK mseconds */
-    plast = NULL;
-    for (ps=samples; ps; ) {
-	unsigned et = tv_ago_msecs(ps->t);
-	if (et <= GOBACK_MS) {
-	    ttl += ps->nbytes;
-	    etime_ms = et;
-	    plast = ps;
-	    ps = ps->next;
-	} else {
-	    struct sample *pn = ps->next;
-	    if (plast) {
-		plast->next = NULL; /* bisect the list */
-		plast = NULL;
-	    }
-	    free(ps);
-	    if (ps == samples)
-		samples = NULL; /* whole list is empty */
-	    ps = pn;
-	}
-    }
+    struct timeval now;
+    int oldest;
+    u_long etime_ms;
+
+    gettimeofday(&now,NULL);
+    hist[nhist % NHIST].t = now;
+    hist[nhist % NHIST].nbytes = bytes;
+    ++nhist;
+
+    oldest = (nhist < NHIST) ? 0 : nhist % NHIST;
+    etime_ms = tv_ago_msecs(hist[oldest].t);
 
     /* if no elapsed time, no work done */
     if (etime_ms == 0) {
 	return(0.0);
     }
 
-    return(((float) ttl)/ ((float)etime_ms / 1000));
+    return(((float) (bytes - hist[oldest].nbytes)) / ((float)etime_ms / 1000));
 }
 
 
-
-
-void
-drawtick(int len, int nbytes)
+static void
+render(void)
 {
+	static int ticker = 0;
+	static char ticks[] = {'-', '/', '|', '\\' };
+	unsigned long count = atomic_load_explicit(&tickcount,
+						   memory_order_relaxed);
+	float tput = calc_tput(atomic_load_explicit(&tickbytes,
+						    memory_order_relaxed));
 	int i;
 	int newpos;
-	double tput = 0;
 
-	count += len;
+	if (!showbar) {
+	    ticker = (ticker+1) % 4;
+	    fprintf(stderr,"\r%s/s %c  ", outfmt(tput), ticks[ticker]);
+	    fflush(stderr);
+	    return;
+	}
 
 	newpos = (int) ((float) count / pertick);
-	if (speed) 
-	    tput = calc_tput(nbytes);
-	if (newpos != currpos) {
-	    if (speed) {
+	if (newpos > linelength)
+	    newpos = linelength;
+	if (newpos != currpos || speed) {
+	    char bar[DEFAULT_LINELENGTH + 1];
+
+	    for (i=0; i < linelength; ++i)
+		bar[i] = (i < newpos) ? '#' : '-';
+	    bar[i] = '\0';
+	    if (speed)
 		fprintf(stderr,"%s/s ", outfmt(tput));
-	    }
-	    fprintf(stderr,"|");
-	    for (i=0; i < linelength; ++i) {
-		if (i<newpos)
-		    fprintf(stderr,"#");
-		else
-		    fprintf(stderr,"-");
-	    }
-	    fprintf(stderr,"| %c", '\015');
+	    fprintf(stderr,"|%s| %c", bar, '\015');
+	    fflush(stderr);
 	}
-
 	currpos = newpos;
+}
+
 
-	fflush(stderr);
+static void *
+tickthread(
+    void *arg)
+{
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	pthread_mutex_lock(&lock);
+	while (!stopping) {
+	    deadline.tv_nsec += REFRESH_MS * 1000000L;
+	    while (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_nsec -= 1000000000L;
+		++deadline.tv_sec;
+	    }
+	    while (!stopping &&
+		   pthread_cond_timedwait(&wake, &lock, &deadline) != ETIMEDOUT)
+		;
+	    if (!stopping)
+		render();
+	}
+	pthread_mutex_unlock(&lock);
+	return(NULL);
 }
 
 
+/* max is the number of drawtick()s for a full bar, 0 for just -S */
 void
-tickdone(void)
+inittick(int max)
 {
-	fprintf(stderr,"\n");
-}
+	pthread_condattr_t attr;
 
+	currpos = 0;
+	nhist = 0;
+	atomic_store(&tickcount, 0);
+	atomic_store(&tickbytes, 0);
 
+	showbar = (max > 0);
+	linelength = DEFAULT_LINELENGTH;
+	if (speed) linelength -= 10;/* make room for speed digits */
+	pertick = (float) max / (float)linelength;
 
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&wake, &attr);
+	pthread_condattr_destroy(&attr);
 
+	(void)calc_tput(0);
+	stopping = 0;
+	if (pthread_create(&reporter, NULL, tickthread, NULL) != 0)
+	    sys_err("pthread_create");
+	running = 1;
+}
+
+
+void
+drawtick(int len, int nbytes)
+{
+	atomic_fetch_add_explicit(&tickcount, len, memory_order_relaxed);
+	atomic_fetch_add_explicit(&tickbytes, nbytes, memory_order_relaxed);
+}
 
 
 void
 dospeed(int bytes)
 {
-    float tput = calc_tput(bytes);
-    static int ticker = 0;
-    static char ticks[] = {'-', '/', '|', '\\' };
-    static struct timeval last = {0,0};
-
-    if (tv_iszero(last) || (tv_ago_msecs(last) > 250)) {
-	ticker = (ticker+1) % 4;
-	fprintf(stderr,"\r%s/s %c  ", outfmt(tput), ticks[ticker]);
-	gettimeofday(&last, NULL);
-    }
+	atomic_fetch_add_explicit(&tickbytes, bytes, memory_order_relaxed);
+}
+
 
-    fflush(stderr);
+/* stop the reporter and leave the final state on the screen */
+void
+tickdone(void)
+{
+	if (!running)
+	    return;
+	pthread_mutex_lock(&lock);
+	stopping = 1;
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&lock);
+	pthread_join(reporter, NULL);
+	pthread_cond_destroy(&wake);
+	running = 0;
+
+	render();
+	fprintf(stderr,"\n");
 }
@@ -0,0 +1,209 @@
+/*
+ * trace.c - replay a trace of writes, or capture one of reads (-Y)
+ *
+ * A trace is a text file with one line per I/O call:
+ *
+ *	usecs-since-the-previous-call bytes
+ *
+ * The transmitter writes each entry at its scheduled time, measured
+ * from the start on the monotonic clock: it sleeps until just short
+ * of the deadline and spins the rest of the way, so bursts of
+ * back-to-back writes stay bursts.  How late each write started is
+ * reported as the drift from the schedule.  The receiver records
+ * what each read actually returned, and when, in the same format,
+ * so a capture can be replayed.
+ *
+ * With -u each entry is a datagram: one of 4 bytes or less is padded
+ * to 5 so the receiver doesn't take it for an end marker, and one
+ * bigger than UDP allows is split into back-to-back datagrams.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include "samples.h"
+#include "trace.h"
+
+extern int trans;
+extern int udp;
+extern char *tracefile;
+extern unsigned long nbytes;
+
+void sys_err(char *s);
+void pattern(register char *cp, register int cnt);
+int Nwrite(int fd, void *buf, int count);
+
+#define SPIN_NSECS 50000	/* spin, don't sleep, this close to a deadline */
+#define MAXDGRAM 65507		/* the most a UDP datagram carries */
+
+struct tentry {
+    double gap;			/* usecs since the previous call */
+    int bytes;
+};
+
+static struct tentry *trace;	/* what we read or captured */
+static int ntrace, maxtrace;
+static double tlast;		/* capture: time of the previous read */
+static struct samples drift;	/* replay: usecs late starting each write */
+
+
+static double
+now_usecs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec * 1e6 + ts.tv_nsec / 1e3);
+}
+
+
+static void
+trace_add(
+    double gap,
+    int bytes)
+{
+    if (ntrace == maxtrace) {
+	maxtrace = maxtrace ? maxtrace * 2 : 4096;
+	if ((trace = realloc(trace, maxtrace * sizeof(struct tentry))) == NULL)
+	    sys_err("malloc");
+    }
+    trace[ntrace].gap = gap;
+    trace[ntrace].bytes = bytes;
+    ++ntrace;
+}
+
+
+static void
+trace_load(void)
+{
+    char line[256];
+    double gap;
+    int bytes;
+    FILE *f;
+
+    if ((f = fopen(tracefile, "r")) == NULL) {
+	perror(tracefile);
+	exit(1);
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+	if (line[0] == '#')
+	    continue;
+	if (sscanf(line, "%lf %d", &gap, &bytes) != 2 || bytes <= 0)
+	    continue;
+	if (gap < 0)
+	    gap = 0;
+	if (udp) {
+	    for (; bytes > MAXDGRAM; bytes -= MAXDGRAM, gap = 0)
+		trace_add(gap, MAXDGRAM);
+	    if (bytes < 5)
+		bytes = 5;	/* 4 bytes or less is the end marker */
+	}
+	trace_add(gap, bytes);
+    }
+    fclose(f);
+    if (ntrace == 0) {
+	fprintf(stderr, "ttcp-t: %s: no \"usecs bytes\" lines\n", tracefile);
+	exit(1);
+    }
+}
+
+
+/* wait until the monotonic clock reaches usecs */
+static void
+trace_waituntil(
+    double usecs)
+{
+    struct timespec ts;
+    double early = usecs - SPIN_NSECS / 1000.0;
+
+    if (now_usecs() < early) {
+	ts.tv_sec = (time_t) (early / 1e6);
+	ts.tv_nsec = (long) ((early - ts.tv_sec * 1e6) * 1000.0);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+	    ;
+    }
+    while (now_usecs() < usecs)
+	;			/* spin */
+}
+
+
+void
+trace_replay(
+    int fd)
+{
+    char *payload;
+    double start, when, late;
+    int maxbytes = 0;
+    int i;
+
+    if (trace == NULL)
+	trace_load();
+    for (i=0; i < ntrace; ++i)
+	if (trace[i].bytes > maxbytes)
+	    maxbytes = trace[i].bytes;
+    if ((payload = malloc(maxbytes)) == NULL)
+	sys_err("malloc");
+    pattern(payload, maxbytes);
+
+    samples_free(&drift);
+    start = when = now_usecs();
+    for (i=0; i < ntrace; ++i) {
+	when += trace[i].gap;
+	trace_waituntil(when);
+	late = now_usecs() - when;
+	samples_add(&drift, late);
+	if (Nwrite(fd, payload, trace[i].bytes) != trace[i].bytes)
+	    break;
+	nbytes += trace[i].bytes;
+    }
+    fprintf(stdout, "ttcp-t: replayed %d of %d writes, scheduled %.3f sec, took %.3f sec\n",
+	    i, ntrace, (when - start) / 1e6, (now_usecs() - start) / 1e6);
+    free(payload);
+}
+
+
+void
+trace_record(
+    int cnt)
+{
+    double now = now_usecs();
+
+    trace_add(ntrace ? now - tlast : 0.0, cnt);
+    tlast = now;
+}
+
+
+void
+trace_save(void)
+{
+    FILE *f;
+    int i;
+
+    if ((f = fopen(tracefile, "w")) == NULL) {
+	perror(tracefile);
+	exit(1);
+    }
+    fprintf(f, "# ttcp trace: usecs-since-previous bytes\n");
+    for (i=0; i < ntrace; ++i)
+	fprintf(f, "%.3f %d\n", trace[i].gap, trace[i].bytes);
+    fclose(f);
+    ntrace = 0;
+}
+
+
+void
+trace_report(void)
+{
+    if (trans) {
+	fprintf(stdout, "ttcp-t: drift from schedule usecs: %s\n",
+		samples_format(&drift));
+    } else {
+	fprintf(stdout, "ttcp-r: captured %d reads to %s\n",
+		ntrace, tracefile);
+	trace_save();
+    }
+}
@@ -0,0 +1,4 @@
+void trace_replay(int fd);
+void trace_record(int cnt);
+void trace_save(void);
+void trace_report(void);
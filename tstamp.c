@@ -0,0 +1,361 @@
+/*
+ * tstamp.c - one-way delay of UDP datagrams from kernel timestamps (-K)
+ *
+ * The transmitter stamps each datagram's payload with a sequence
+ * number and the time it was handed to sendto(), and collects the
+ * kernel's (or NIC's) transmit timestamps from the error queue to
+ * see how long the datagram spent in its own stack.  The receiver
+ * takes the kernel receive timestamp from SO_TIMESTAMPING rather
+ * than calling gettimeofday() after the scheduler gets around to it.
+ *
+ * Unless the two clocks are known to agree (same host, or both
+ * disciplined by PTP: "sync"), only the delay variation is
+ * meaningful, so that is what gets reported: each delay less the
+ * smallest one seen, along with the RFC 3550 interarrival jitter.
+ *
+ * Hardware stamps come from the NIC's own clock, not CLOCK_REALTIME,
+ * so they are only measured against the send times with "sync", which
+ * for them means phc2sys is keeping that clock on system time.
+ * Otherwise the software stamp is used and the hardware ones counted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#ifdef __linux__
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <linux/sockios.h>
+#endif
+#include "samples.h"
+#include "tstamp.h"
+
+extern int trans;
+extern struct sockaddr *peer;
+extern socklen_t peerlen;
+extern unsigned long numCalls;
+
+void sys_err(char *s);
+
+/* what rides at the front of each datagram */
+struct tshdr {
+    uint32_t seq;
+    uint32_t pad;
+    int64_t sec;		/* CLOCK_REALTIME at sendto() */
+    int64_t nsec;
+};
+
+static int hwstamps = 0;	/* ask the NIC for timestamps */
+static char *hwif;		/*  on this interface */
+static int synced = 0;		/* clocks agree, delays are absolute */
+
+#define RING 4096		/* sends remembered for their TX stamps */
+static double sendtimes[RING];	/* user send time by send number */
+static uint32_t nsends;		/* datagrams sent, SOF_TIMESTAMPING_OPT_ID */
+static uint32_t seq;		/* stamped datagrams sent */
+
+static struct samples stackdelay; /* sendto() until the TX stamp, usecs */
+static struct samples delays;	/* send stamp until RX stamp, usecs */
+static unsigned long nrecv, nreorder, nhw;
+static uint32_t maxseq;
+static double jitter, lastdelay;
+
+
+static double
+ts_usecs(
+    struct timespec *pts)
+{
+    return(pts->tv_sec * 1e6 + pts->tv_nsec / 1e3);
+}
+
+
+void
+tstampopt(
+    char *spec)
+{
+    char *word;
+
+    spec = strdup(spec);
+    for (word = strtok(spec, ","); word; word = strtok(NULL, ",")) {
+	if (strcmp(word, "sw") == 0)
+	    hwstamps = 0;
+	else if (strncmp(word, "hw", 2) == 0) {
+	    hwstamps = 1;
+	    if (word[2] == '=')
+		hwif = word + 3;
+	} else if (strcmp(word, "sync") == 0)
+	    synced = 1;
+	else {
+	    fprintf(stderr, "ttcp: bad -K %s, expected sw|hw[=if][,sync]\n",
+		    word);
+	    exit(1);
+	}
+    }
+}
+
+
+void
+tstamp_setup(
+    int fd)
+{
+#if defined(__linux__) && defined(SO_TIMESTAMPING)
+    int flags;
+
+    if (hwstamps && hwif) {
+	struct hwtstamp_config cfg;
+	struct ifreq ifr;
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.tx_type = HWTSTAMP_TX_ON;
+	cfg.rx_filter = HWTSTAMP_FILTER_ALL;
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, hwif, sizeof(ifr.ifr_name) - 1);
+	ifr.ifr_data = (void *)&cfg;
+	if (ioctl(fd, SIOCSHWTSTAMP, &ifr) < 0)
+	    fprintf(stderr,
+		    "ttcp%s: %s: no hardware timestamps (%s), using software\n",
+		    trans ? "-t" : "-r", hwif, strerror(errno));
+    }
+
+    flags = SOF_TIMESTAMPING_SOFTWARE;
+    if (hwstamps)
+	flags |= SOF_TIMESTAMPING_RAW_HARDWARE;
+    if (trans) {
+	flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_OPT_ID |
+	    SOF_TIMESTAMPING_OPT_TSONLY;
+	if (hwstamps)
+	    flags |= SOF_TIMESTAMPING_TX_HARDWARE;
+    } else {
+	flags |= SOF_TIMESTAMPING_RX_SOFTWARE;
+	if (hwstamps)
+	    flags |= SOF_TIMESTAMPING_RX_HARDWARE;
+    }
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING,
+		   (char *)&flags, sizeof(flags)) < 0)
+	sys_err("setsockopt: timestamping");
+#else
+    fprintf(stderr, "ttcp: -K not supported on this system\n");
+    exit(1);
+#endif
+}
+
+
+/*
+ * before each run: a -R receiver keeps its socket, and with it the
+ * timestamping set up for the first run, but the counts start over
+ */
+void
+tstamp_start(void)
+{
+    nsends = seq = 0;
+    nrecv = nreorder = nhw = 0;
+    maxseq = 0;
+    jitter = lastdelay = 0.0;
+    samples_free(&stackdelay);
+    samples_free(&delays);
+}
+
+
+#ifdef __linux__
+/*
+ * the hardware stamp if there is one and its clock can be trusted
+ * (see above), else the software one
+ */
+static struct timespec *
+tstamp_pick(
+    struct msghdr *pmsg)
+{
+    struct cmsghdr *cm;
+    struct scm_timestamping *pts;
+
+    for (cm = CMSG_FIRSTHDR(pmsg); cm; cm = CMSG_NXTHDR(pmsg, cm)) {
+	if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_TIMESTAMPING)
+	    continue;
+	pts = (struct scm_timestamping *) CMSG_DATA(cm);
+	if (pts->ts[2].tv_sec || pts->ts[2].tv_nsec) {
+	    ++nhw;
+	    if (synced)
+		return(&pts->ts[2]);
+	}
+	if (pts->ts[0].tv_sec || pts->ts[0].tv_nsec)
+	    return(&pts->ts[0]);
+    }
+    return(NULL);
+}
+
+
+/* pick up any transmit timestamps waiting on the error queue */
+static void
+tstamp_txdrain(
+    int fd)
+{
+    char control[512];
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    struct sock_extended_err *pee;
+    struct timespec *pts;
+    uint32_t id;
+
+    while (1) {
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+	    break;
+	pts = tstamp_pick(&msg);
+	pee = NULL;
+	for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+	    if ((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+		(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+		pee = (struct sock_extended_err *) CMSG_DATA(cm);
+	}
+	if (pts == NULL || pee == NULL ||
+	    pee->ee_origin != SO_EE_ORIGIN_TIMESTAMPING)
+	    continue;
+	id = pee->ee_data;
+	if (nsends - id <= RING && sendtimes[id % RING] != 0.0)
+	    samples_add(&stackdelay, ts_usecs(pts) - sendtimes[id % RING]);
+    }
+    errno = 0;
+}
+#endif
+
+
+int
+tstamp_send(
+    int fd,
+    void *buf,
+    int count)
+{
+    struct tshdr *ph = buf;
+    struct timespec now;
+    int stamped = count >= sizeof(struct tshdr);
+    int cnt;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (stamped) {
+	ph->seq = seq;
+	ph->pad = 0;
+	ph->sec = now.tv_sec;
+	ph->nsec = now.tv_nsec;
+    }
+    sendtimes[nsends % RING] = ts_usecs(&now);
+    cnt = sendto(fd, buf, count, 0, peer, peerlen);
+    numCalls++;
+    /* an ENOBUFS retry resends the same number, or it'd count as lost */
+    if (cnt >= 0) {
+	++nsends;
+	if (stamped)
+	    ++seq;
+    }
+#ifdef __linux__
+    if (cnt >= 0) {
+	int save = errno;
+	tstamp_txdrain(fd);
+	errno = save;
+    }
+#endif
+    return(cnt);
+}
+
+
+int
+tstamp_recv(
+    int fd,
+    void *buf,
+    int count)
+{
+#ifdef __linux__
+    char control[512];
+    struct sockaddr_storage from;
+    struct msghdr msg;
+    struct iovec iov;
+    struct timespec *prx;
+    struct timespec sent;
+    struct tshdr *ph = buf;
+    double delay;
+    int cnt;
+
+    iov.iov_base = buf;
+    iov.iov_len = count;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &from;
+    msg.msg_namelen = sizeof(from);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cnt = recvmsg(fd, &msg, 0);
+    numCalls++;
+    if (cnt < (int) sizeof(struct tshdr) || (prx = tstamp_pick(&msg)) == NULL)
+	return(cnt);
+
+    ++nrecv;
+    if (nrecv > 1 && ph->seq < maxseq)
+	++nreorder;
+    else
+	maxseq = ph->seq;
+
+    sent.tv_sec = ph->sec;
+    sent.tv_nsec = ph->nsec;
+    delay = ts_usecs(prx) - ts_usecs(&sent);
+    samples_add(&delays, delay);
+
+    /* RFC 3550 interarrival jitter, independent of clock offset */
+    if (nrecv > 1) {
+	double d = delay - lastdelay;
+	jitter += ((d < 0 ? -d : d) - jitter) / 16.0;
+    }
+    lastdelay = delay;
+
+    return(cnt);
+#else
+    return(recv(fd, buf, count, 0));
+#endif
+}
+
+
+void
+tstamp_report(void)
+{
+    double min;
+    int i;
+
+    if (nhw && !synced)
+	fprintf(stdout,
+		"ttcp%s: %lu hardware stamps not used, the NIC clock isn't system time (run phc2sys and add ,sync)\n",
+		trans ? "-t" : "-r", nhw);
+    if (trans) {
+	fprintf(stdout, "ttcp-t: %s timestamps: %u datagrams, %d TX stamps\n",
+		nhw && synced ? "hardware" : "software", nsends, stackdelay.n);
+	fprintf(stdout, "ttcp-t: sendto to TX stamp usecs: %s\n",
+		samples_format(&stackdelay));
+	return;
+    }
+
+    fprintf(stdout,
+	    "ttcp-r: %s timestamps: %lu datagrams, %lu lost, %lu reordered\n",
+	    nhw && synced ? "hardware" : "software", nrecv,
+	    nrecv ? maxseq + 1 - nrecv : 0, nreorder);
+    if (synced) {
+	fprintf(stdout, "ttcp-r: one-way delay usecs: %s\n",
+		samples_format(&delays));
+    } else {
+	/* clocks may be offset, measure from the fastest datagram */
+	min = samples_pct(&delays, 0.0);
+	for (i=0; i < delays.n; ++i)
+	    delays.v[i] -= min;
+	fprintf(stdout, "ttcp-r: delay variation usecs: %s\n",
+		samples_format(&delays));
+    }
+    fprintf(stdout, "ttcp-r: jitter %.1f usecs\n", jitter);
+}
@@ -0,0 +1,6 @@
+void tstampopt(char *spec);
+void tstamp_setup(int fd);
+void tstamp_start(void);
+int tstamp_send(int fd, void *buf, int count);
+int tstamp_recv(int fd, void *buf, int count);
+void tstamp_report(void);
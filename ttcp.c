@@ -31,6 +31,65 @@
  * Modified Oct. 1991 at Silicon Graphics, Inc.
  *	use getopt(3) for option processing, add -f and -T options.
  *	SGI IRIX 3.3 and 4.0 releases don't need #define SYSV.
+ * Local IPC transports
+ *	-U runs the same tests over AF_UNIX sockets, socketpairs and pipes
+ * Connection rate mode
+ *	-C measures connects/sec from -j threads, -L sets the close linger
+ * Congestion control
+ *	-Z sets TCP_CONGESTION, a list compares algorithms side by side
+ *	-k lets one receiver serve several (or endless) connections
+ * Repeated runs
+ *	-R runs the test several times and summarizes, -o/-c save and
+ *	compare against a baseline; a file on stdin is rewound per run
+ * Sweeps
+ *	-X sweeps -l, -b, -D and the number of streams against one receiver
+ * Send queue latency
+ *	-w sets TCP_NOTSENT_LOWAT, writes on EPOLLOUT and samples the queue
+ * One-way delay
+ *	-K stamps UDP datagrams and uses SO_TIMESTAMPING for delay and jitter
+ * Message mode
+ *	-M frames the stream into messages with sizes from a distribution
+ * Traces
+ *	-Y replays a trace of write sizes and gaps, or captures the reads
+ * Memory mapped files
+ *	-F sends from or receives into an mmap()ed file instead of stdin/stdout
+ * Pipelined disk I/O
+ *	-Q runs stdout through a ring of buffers and O_DIRECT writer threads
+ *	   and, for -t, fills the ring from stdin in a reader thread
+ * Progress display
+ *	-P and -S draw from a reporter thread, the I/O loops just count
+ * Live statistics
+ *	-E serves the counters, CPU and TCP_INFO over HTTP, a unix socket
+ *	   or a file, in Prometheus format, while the test runs
+ * Receiver daemon
+ *	-G keeps a receiver up between tests, taking each session's -l, -s
+ *	   and -T from the transmitter and remembering the results; -q asks
+ *	   it for them
+ * Hardware counters
+ *	-H counts cycles, instructions and cache and branch misses over
+ *	   the timed part with perf_event_open()
+ * System wide CPU
+ *	-I adds the whole machine's usr/sys/irq/softirq time from /proc/stat
+ *	   per GB, and the busiest cores
+ * Kernel TLS
+ *	-e encrypts the stream with kTLS using a fixed key, no handshake
+ * Packet ring receiver
+ *	-N receives -u -s from a TPACKET_V3 ring instead of recvfrom()
+ * Bursts
+ *	-a sends on/off bursts on a fixed schedule and reports how long
+ *	   each took to go out and, at the receiver, to arrive
+ * Zero-copy receive
+ *	-z maps received pages into the receiver with TCP_ZEROCOPY_RECEIVE
+ *	   instead of copying them into buf
+ * AF_XDP
+ *	-x sends or receives -u -s through an AF_XDP socket, zero-copy
+ *	   where the driver allows, generic (skb) mode anywhere
+ * Benchmarks
+ *	make bench runs a loopback matrix with -R/-o/-c (bench.sh)
+ *	make micro times the hot helpers on their own (micro.c)
+ * Buffer autotuning
+ *	-W sets -b from the bandwidth-delay product, RTT from a probe and
+ *	   the rate from a kernel autotuned run, and compares the two
  *
  * Distribution Status -
  *      Public Domain.  Distribution Unlimited.
@@ -49,6 +108,10 @@ static char const RCSid[] = "ttcp.c $Revision: 1.6 $";
 #include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <stddef.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
@@ -56,6 +119,26 @@ static char const RCSid[] = "ttcp.c $Revision: 1.6 $";
 #include <sys/time.h>		/* struct timeval */
 
 #include "ticks.h"
+#include "connrate.h"
+#include "cc.h"
+#include "repeat.h"
+#include "sweep.h"
+#include "autobuf.h"
+#include "lowat.h"
+#include "tstamp.h"
+#include "msg.h"
+#include "trace.h"
+#include "mapio.h"
+#include "ring.h"
+#include "stats.h"
+#include "daemon.h"
+#include "pmu.h"
+#include "syscpu.h"
+#include "ktls.h"
+#include "pktring.h"
+#include "xsk.h"
+#include "burst.h"
+#include "zcrecv.h"
 
 
 #if defined(SYSV)
@@ -72,8 +155,21 @@ struct OLDrusage {
 struct sockaddr_in sinme;
 struct sockaddr_in sinhim;
 struct sockaddr_in frominet;
-
-int domain;
+struct sockaddr_un sunme;
+struct sockaddr_un sunhim;
+socklen_t sunlen;		/* length of AF_UNIX address in use */
+struct sockaddr *peer;		/* where datagrams are sent */
+socklen_t peerlen;
+
+int domain = AF_INET;		/* AF_INET or AF_UNIX */
+int socktype = 0;		/* SOCK_STREAM, SOCK_DGRAM, SOCK_SEQPACKET */
+int ipc = 0;			/* local IPC transport (-U), see below */
+#define IPC_NONE	0	/* internet socket */
+#define IPC_UNIX	1	/* AF_UNIX socket on a path */
+#define IPC_PIPE	2	/* anonymous pipe, forked receiver */
+#define IPC_PAIR	3	/* socketpair, forked receiver */
+char *unixpath;			/* AF_UNIX path, "@name" is abstract */
+pid_t child;			/* forked receiver for pipe/socketpair */
 int fd;				/* fd of network socket */
 
 int buflen = 8 * 1024;		/* length of buffer */
@@ -101,6 +197,38 @@ char fmt = 'm';			/* output format: k = kilobits, K = kilobytes,
 int touchdata = 0;		/* access data after reading */
 int progress = 0;		/* print progress line (sdo) */
 int speed = 0;			/* print speed updates */
+int lingertime = 60*4;		/* SO_LINGER seconds on close, -1 = off */
+int conns = 0;			/* connection rate mode: connections */
+int connpayload = 0;		/*  bytes written on each */
+int nthreads = 1;		/* worker threads */
+char *ccname;			/* TCP_CONGESTION algorithm (-Z) */
+int sessions = 1;		/* connections to serve, 0 = forever */
+int repeat = 1;			/* number of runs */
+int listenfd = -1;		/* -r socket kept between runs */
+char *basesave;			/* file to save the runs in */
+char *basefile;			/* baseline file to compare with */
+int sweeping = 0;		/* -X given */
+int autobufs = 0;		/* -W: -b from the BDP */
+int lowat = 0;			/* TCP_NOTSENT_LOWAT, 0 = plain writes */
+int lowatms = 10;		/*  send queue sampling interval, msecs */
+int tstamping = 0;		/* kernel timestamped UDP (-K) */
+int msgmode = 0;		/* length prefixed messages (-M) */
+char *tracefile;		/* -t: trace to replay, -r: to capture */
+char *mapfile;			/* mmap()ed file in place of stdin/stdout */
+int ringslots = 0;		/* pipeline stdin/stdout through this many bufs */
+int ringthreads = 1;		/*  with this many disk threads */
+char *statsspec;		/* live stats endpoint (-E) */
+int daemonhist = 0;		/* -r: daemon keeping this many results */
+char *sessiontag;		/* -t: talking to a daemon, tag for the result */
+int daemonquery = 0;		/* -t: ask a daemon for its results */
+int pmu = 0;			/* hardware counters (-H) */
+int syscpu = 0;			/* system wide CPU report (-I) */
+int cpuinterval = 0;		/*  sampled every this many secs, 0 = not */
+int ktls = 0;			/* kTLS cipher (-e), 0 = cleartext */
+char *ringif;			/* -u -s -r from a packet ring on this if */
+char *xdpif;			/* -u -s through AF_XDP on this if */
+char *burstspec;		/* on/off bursts (-a) */
+int zcrecv = 0;			/* -r -s: map, don't copy (-z) */
 
 struct hostent *addr;
 extern int errno;
@@ -122,14 +250,63 @@ Common options:\n\
 	-d	set SO_DEBUG socket option\n\
 	-b ##	set socket buffer size (if supported)\n\
 	-f X	format for rate: k,K = kilo{bit,byte}; m,M = mega; g,G = giga\n\
+	-K X	UDP one-way delay from kernel timestamps, X is sw or\n\
+		hw[=interface], add \",sync\" if both ends share a clock\n\
+	-M X	for -s, send -n length prefixed messages with sizes from\n\
+		fixed:N, uniform:LO,HI, exp:MEAN or cdf:FILE\n\
+	-F F	without -s, -t: send file F from an mmap()ed view of it\n\
+		-r: receive into file F through mmap()ed windows\n\
+	-Q n[,t] without -s, overlap stdin/stdout with the network using\n\
+		a ring of n buffers; -t: a thread reads stdin into it,\n\
+		-r: t threads write it to stdout (O_DIRECT for files)\n\
+	-Y F	-t: replay the writes (\"usecs-gap bytes\" lines) in trace F\n\
+		-r: capture the size and timing of each read to trace F\n\
+	-E X[,##] serve live stats every ## secs (default 1), X is http:PORT\n\
+		(on 127.0.0.1), unix:PATH or file:PATH (rewritten)\n\
+	-H	count cycles, instructions, cache and branch misses per byte\n\
+		and per call with perf_event_open()\n\
+	-I ##	report system wide CPU (incl. softirq on other cores) per GB\n\
+		and the busiest cores, sampling every ## secs (0 = don't)\n\
+	-e X	encrypt with kernel TLS and a fixed test key, X is the\n\
+		cipher: aes128, aes256 or chacha20 (sendfile() with -F)\n\
+	-x X	with -u -s, bypass the socket through AF_XDP on interface\n\
+		X[:queue][,zc|copy|skb] (default: best mode that works)\n\
+	-a X	with -s, send bursts: X is SIZE[k|m|b],MSECS[,DUTY%%], SIZE\n\
+		bytes (b: -l bufs) every MSECS spread over DUTY%% of it;\n\
+		give the receiver the same -a for per-burst arrival times\n\
+	-R ##	repeat the test ## times and summarize the runs\n\
+	-o F	save the runs' results to baseline file F\n\
+	-c F	compare the runs with baseline file F (exit 2 on regression)\n\
+	-U X	use local IPC instead of the network, X is one of\n\
+		[stream:|seqpacket:|dgram:]path  AF_UNIX socket (@path = abstract)\n\
+		pipe, socketpair[:stream|:seqpacket|:dgram]  fork a receiver\n\
+	-L ##	linger this many seconds on close (default 240, -1 = off)\n\
+	-C ##[,##]  connection rate: make/accept ## connections,\n\
+		writing the second ## bytes on each (default 0)\n\
+	-j ##	number of threads connecting or accepting for -C (default 1)\n\
+	-Z X	congestion control algorithm, a comma separated list (-t)\n\
+		compares them, running -j streams at once\n\
+	-X d=V	sweep dimension d (l, b, D or j) over values V, a list\n\
+		N,N,... or a doubling range LO..HI; -X may be repeated\n\
 Options specific to -t:\n\
 	-n##	number of source bufs written to network (default 2048)\n\
 	-D	don't buffer TCP writes (sets TCP_NODELAY socket option) (Nagle)\n\
 	-P	print progress histogram as you go\n\
 	-S	print throughput (speed) as you go\n\
+	-w ##[,##]  set TCP_NOTSENT_LOWAT to ## bytes, write only when epoll\n\
+		says writable, sample the send queue every ## msecs (default 10)\n\
+	-W X	pick -b from the bandwidth-delay product and compare with\n\
+		kernel autotuning, X is bdp or search (also try 1/4..4x)\n\
+	-G X	send this session's -l, -s and -T to a -G receiver, tagged X\n\
+	-q	print a -G receiver's session history instead of testing\n\
 Options specific to -r:\n\
 	-B	for -s, only output full blocks as specified by -l (for TAR)\n\
 	-T	\"touch\": access each byte as it's read\n\
+	-k ##	serve ## connections, each in its own process (0 = forever)\n\
+	-N X	with -u -s, receive from a TPACKET_V3 ring on interface X\n\
+	-z	for -s, map the data in with TCP_ZEROCOPY_RECEIVE, not read()\n\
+	-G ##	daemon: serve sessions forever with the transmitter's -l, -s\n\
+		and -T, remembering the last ## results\n\
 ";	
 
 char stats[128];
@@ -140,6 +317,7 @@ double cput, realt;		/* user, real time (seconds) */
 void sys_err(char *s);
 void mes(char *s);
 void pattern(register char *cp, register int cnt);
+void touch(register char *b, register int c);
 void prep_timer(void);
 double read_timer(char *str, int len);
 int Nread(int fd, void *buf, int count);
@@ -147,6 +325,15 @@ int Nwrite(int fd, void *buf, int count);
 void delay(int us);
 int mread(int fd, register char *bufp, unsigned int n);
 char *outfmt(double b);
+void ipcopt(char *spec);
+void pairsetup(void);
+void netsetup(void);
+void transfer(void);
+char *transport(void);
+int setlinger(int fd);
+int Naccept(int lfd);
+void serve(int lfd);
+void report(void);
 
 void
 sigpipe(int sig)
@@ -159,11 +346,12 @@ main(
     char **argv)
 {
 	unsigned long addr_tmp;
+	int run;
 	int c;
 
 	if (argc < 2) goto usage;
 
-	while ((c = getopt(argc, argv, "drstuvBDTSPb:f:l:n:p:A:O:")) != -1) {
+	while ((c = getopt(argc, argv, "drstuvBDTSPb:f:l:n:p:A:O:U:L:C:j:Z:k:R:o:c:X:w:K:M:Y:F:Q:E:G:qHI:e:N:x:a:zW:")) != -1) {
 		switch (c) {
 
 		case 'B':
@@ -230,12 +418,149 @@ main(
 		case 'T':
 			touchdata = 1;
 			break;
+		case 'U':
+			ipcopt(optarg);
+			break;
+		case 'L':
+			lingertime = atoi(optarg);
+			break;
+		case 'C':
+			conns = atoi(optarg);
+			if (strchr(optarg, ',') != NULL)
+				connpayload = atoi(strchr(optarg, ',') + 1);
+			if (conns <= 0)
+				goto usage;
+			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			if (nthreads <= 0)
+				goto usage;
+			break;
+		case 'Z':
+#ifdef TCP_CONGESTION
+			ccname = optarg;
+#else
+			fprintf(stderr, 
+	"ttcp: -Z option ignored: TCP_CONGESTION socket option not supported\n");
+#endif
+			break;
+		case 'k':
+			sessions = atoi(optarg);
+			if (sessions < 0)
+				goto usage;
+			break;
+		case 'G':
+			sessiontag = optarg;	/* -r: sorted out below */
+			break;
+		case 'q':
+			daemonquery = 1;
+			break;
+		case 'H':
+			pmu = 1;
+			break;
+		case 'N':
+			ringif = optarg;
+			break;
+		case 'x':
+			xdpif = optarg;
+			break;
+		case 'z':
+			zcrecv = 1;
+			break;
+		case 'a':
+			burstspec = optarg;
+			burstopt(optarg);
+			break;
+		case 'e':
+			if ((ktls = ktls_cipher(optarg)) == 0) {
+				fprintf(stderr, "ttcp: -e: unknown cipher %s\n",
+				    optarg);
+				exit(1);
+			}
+			break;
+		case 'I':
+			syscpu = 1;
+			cpuinterval = atoi(optarg);
+			if (cpuinterval < 0)
+				goto usage;
+			break;
+		case 'R':
+			repeat = atoi(optarg);
+			if (repeat <= 0)
+				goto usage;
+			break;
+		case 'o':
+			basesave = optarg;
+			break;
+		case 'c':
+			basefile = optarg;
+			break;
+		case 'X':
+			sweepopt(optarg);
+			sweeping = 1;
+			break;
+		case 'W':
+			autobufopt(optarg);
+			autobufs = 1;
+			break;
+		case 'Y':
+			tracefile = optarg;
+			break;
+		case 'F':
+			mapfile = optarg;
+			break;
+		case 'E':
+			statsspec = optarg;
+			break;
+		case 'Q':
+			ringslots = atoi(optarg);
+			if (strchr(optarg, ',') != NULL)
+				ringthreads = atoi(strchr(optarg, ',') + 1);
+			if (ringslots < 2 || ringthreads < 1)
+				goto usage;
+			break;
+		case 'M':
+			msgopt(optarg);
+			msgmode = 1;
+			break;
+		case 'K':
+			tstampopt(optarg);
+			tstamping = 1;
+			break;
+		case 'w':
+#ifdef TCP_NOTSENT_LOWAT
+			lowat = atoi(optarg);
+			if (strchr(optarg, ',') != NULL)
+				lowatms = atoi(strchr(optarg, ',') + 1);
+			if (lowat <= 0 || lowatms <= 0)
+				goto usage;
+#else
+			fprintf(stderr, 
+	"ttcp: -w option ignored: TCP_NOTSENT_LOWAT socket option not supported\n");
+#endif
+			break;
 
 		default:
 			goto usage;
 		}
 	}
-	if(trans)  {
+	if (ipc == IPC_UNIX || ipc == IPC_PAIR) {
+		if (socktype == 0)
+			socktype = udp ? SOCK_DGRAM : SOCK_STREAM;
+		udp = (socktype == SOCK_DGRAM);
+	}
+	if (ipc == IPC_PIPE)
+		udp = 0;
+	if (ipc == IPC_UNIX) {
+		host = unixpath;
+		if (trans) {
+			sunhim = sunme;
+			peer = (struct sockaddr *)&sunhim;
+			peerlen = sunlen;
+		}
+	} else if (ipc != IPC_NONE) {
+		host = "child";
+	} else if(trans)  {
 		/* xmitr */
 		if (optind == argc)
 			goto usage;
@@ -263,12 +588,130 @@ main(
 		}
 		sinhim.sin_port = htons(port);
 		sinme.sin_port = 0;		/* free choice */
+		peer = (struct sockaddr *)&sinhim;
+		peerlen = sizeof(sinhim);
 	} else {
 		/* rcvr */
 		sinme.sin_port =  htons(port);
 	}
 
 
+	/* before -C goes off on its own */
+	if (burstspec && (!sinkmode || msgmode || tracefile || tstamping ||
+	    ringif || xdpif || conns || zcrecv || b_flag || lowat)) {
+		fprintf(stderr, "ttcp: -a is for -s, without -M, -Y, -K, -N, -x, -C, -z, -B or -w\n");
+		exit(1);
+	}
+	if (zcrecv && (trans || udp || !sinkmode || ipc != IPC_NONE ||
+	    ktls || tstamping || tracefile || b_flag || conns || msgmode)) {
+		fprintf(stderr, "ttcp: -z is for -r -s over TCP, without -U, -e, -K, -Y, -B, -C or -M\n");
+		exit(1);
+	}
+
+	if (conns) {
+		if (udp || ipc == IPC_PIPE || ipc == IPC_PAIR ||
+		    socktype == SOCK_DGRAM) {
+			fprintf(stderr,
+			    "ttcp: -C needs a TCP or AF_UNIX stream socket\n");
+			exit(1);
+		}
+		connrate();
+		exit(0);
+	}
+
+	if (!trans && ccname && strchr(ccname, ',') != NULL)
+		ccname = NULL;		/* the sender does the comparing */
+	if (trans && ccname && strchr(ccname, ',') != NULL) {
+		if (udp || ipc != IPC_NONE) {
+			fprintf(stderr, "ttcp: -Z needs TCP\n");
+			exit(1);
+		}
+		sinkmode = 1;
+	}
+
+	if (trans && sweeping) {
+		if (udp || (ipc != IPC_NONE && ipc != IPC_UNIX)) {
+			fprintf(stderr, "ttcp: -X needs a stream socket\n");
+			exit(1);
+		}
+		sinkmode = 1;
+		buflen = sweepbuflen();	/* so buf is big enough for all */
+	}
+	if (autobufs && (!trans || udp || ipc != IPC_NONE || sweeping)) {
+		fprintf(stderr, "ttcp: -W is for -t over TCP, without -U or -X\n");
+		exit(1);
+	}
+	if (autobufs)
+		sinkmode = 1;
+
+	if (lowat && (udp || ipc != IPC_NONE)) {
+		fprintf(stderr, "ttcp: -w needs TCP\n");
+		exit(1);
+	}
+
+	if (tstamping && (!udp || ipc != IPC_NONE)) {
+		fprintf(stderr, "ttcp: -K needs -u\n");
+		exit(1);
+	}
+	if (msgmode && (udp || socktype == SOCK_DGRAM || !sinkmode)) {
+		fprintf(stderr, "ttcp: -M needs -s and a stream transport\n");
+		exit(1);
+	}
+	if (ringslots && (sinkmode || mapfile || msgmode || tracefile)) {
+		fprintf(stderr, "ttcp: -Q is for stdin/stdout, not -s, -F, -M or -Y\n");
+		exit(1);
+	}
+	if (mapfile && sinkmode) {
+		fprintf(stderr, "ttcp: -F can't be used with -s\n");
+		exit(1);
+	}
+	if (tstamping && buflen < 24)
+		buflen = 24;	/* room for the sequence number and stamp */
+
+	if (sessiontag && !trans) {
+		if ((daemonhist = atoi(sessiontag)) <= 0)
+			goto usage;
+		sessiontag = NULL;
+	}
+	if ((daemonhist || sessiontag || daemonquery) &&
+	    (udp || ipc != IPC_NONE || sessions != 1 || repeat > 1)) {
+		fprintf(stderr, "ttcp: -G and -q are for one TCP connection, not -u, -U, -k or -R\n");
+		exit(1);
+	}
+	if (daemonquery && !trans)
+		goto usage;
+	if (statsspec && (sessions != 1 || daemonhist)) {
+		fprintf(stderr, "ttcp: -E can't see the counters of -k or -G sessions, each is served by its own process\n");
+		exit(1);
+	}
+	if (ringif && (trans || !udp || !sinkmode || ipc != IPC_NONE ||
+	    tstamping || repeat > 1)) {
+		fprintf(stderr, "ttcp: -N is for -r -u -s, without -U, -K or -R\n");
+		exit(1);
+	}
+	if (xdpif && (!udp || !sinkmode || ipc != IPC_NONE || ringif ||
+	    tstamping || repeat > 1)) {
+		fprintf(stderr, "ttcp: -x is for -u -s, without -U, -N, -K or -R\n");
+		exit(1);
+	}
+	if (burstspec && udp && buflen <= 4) {
+		fprintf(stderr, "ttcp: -a -u needs -l of at least 5, for the burst number and to tell data from the end markers\n");
+		exit(1);
+	}
+	if (ktls && (udp || ipc != IPC_NONE || conns)) {
+		fprintf(stderr, "ttcp: -e is for TCP streams, not -u, -U or -C\n");
+		exit(1);
+	}
+	if (basefile && repeat < 2) {
+		fprintf(stderr, "ttcp: -c needs at least -R 2 to compare\n");
+		exit(1);
+	}
+	if (repeat > 1 && (sessions != 1 || ipc == IPC_PIPE || ipc == IPC_PAIR)) {
+		fprintf(stderr, "ttcp: -R can't be used with -k or -U %s\n",
+		    ipc == IPC_PIPE ? "pipe" : "socketpair");
+		exit(1);
+	}
+
 	if (udp && buflen < 5) {
 	    buflen = 5;		/* send more than the sentinel size */
 	}
@@ -276,7 +719,16 @@ main(
 	if ( (buf = (char *)malloc(buflen+bufalign)) == (char *)NULL)
 		sys_err("malloc");
 	if (bufalign != 0)
-		buf +=(bufalign - ((int)buf % bufalign) + bufoffset) % bufalign;
+		buf +=(bufalign - ((unsigned long)buf % bufalign) + bufoffset) % bufalign;
+
+	if (ipc == IPC_PIPE || ipc == IPC_PAIR)
+		pairsetup();		/* parent transmits, child receives */
+
+	if (daemonquery) {
+		netsetup();
+		daemon_query(fd);
+		exit(0);
+	}
 
 	if (trans) {
 	    fprintf(stdout,
@@ -284,27 +736,221 @@ main(
 		buflen, nbuf, bufalign, bufoffset, port);
  	    if (sockbufsize)
  		fprintf(stdout, ", sockbufsize=%d", sockbufsize);
- 	    fprintf(stdout, "  %s  -> %s\n", udp?"udp":"tcp", host);
+ 	    fprintf(stdout, "  %s  -> %s\n", transport(), host);
 	} else {
 	    fprintf(stdout,
  	    "ttcp-r: buflen=%d, nbuf=%d, align=%d/%d, port=%d",
  		buflen, nbuf, bufalign, bufoffset, port);
  	    if (sockbufsize)
  		fprintf(stdout, ", sockbufsize=%d", sockbufsize);
- 	    fprintf(stdout, "  %s\n", udp?"udp":"tcp");
+ 	    fprintf(stdout, "  %s\n", transport());
+	}
+
+	if (trans && ccname && strchr(ccname, ',') != NULL) {
+		cccompare(ccname);
+		exit(0);
+	}
+	if (trans && sweeping) {
+		sweep();
+		exit(0);
+	}
+	if (trans && autobufs) {
+		autobuf();
+		exit(0);
+	}
+
+	if (statsspec)
+		stats_start(statsspec);
+
+	for (run = 0; run < repeat; ++run) {
+		if (ipc == IPC_NONE || ipc == IPC_UNIX)
+			netsetup();
+		if (pmu && run == 0)
+			pmu_open();	/* in the -k or -G session's own child */
+		if (ktls)
+			ktls_setup(fd);
+		if (run > 0 && trans && !sinkmode && !mapfile &&
+		    lseek(0, (off_t)0, SEEK_SET) < 0)
+			errno = 0;	/* not a file, carry on reading */
+
+		transfer();
+		if (statsspec)
+			stats_runend();
+
+		/* sdo -- Thu May 18, 1995 */
+		/* make sure all the data was really delivered */
+		if (!udp)
+		    close(fd);
+		/* end sdo */
+
+		(void)read_timer(stats,sizeof(stats));
+		if(udp&&trans)  {
+			(void)Nwrite( fd, buf, 4 ); /* rcvr end */
+			(void)Nwrite( fd, buf, 4 ); /* rcvr end */
+			(void)Nwrite( fd, buf, 4 ); /* rcvr end */
+			(void)Nwrite( fd, buf, 4 ); /* rcvr end */
+			close(fd);	/* -R makes a new one each run */
+		}
+		if (child > 0)
+			(void)waitpid(child, (int *)0, 0);	/* let it report first */
+		report();
+		if (daemonhist)
+			daemon_result();
+		runsample(nbytes, realt, cput);
+	}
+	if (domain == AF_UNIX && !trans && sessions == 1 &&
+	    sunme.sun_path[0] != '\0')
+		(void)unlink(sunme.sun_path);
+	if (repeat > 1 || basesave || basefile)
+		exit(runsummary());
+	exit(0);
+
+usage:
+	fprintf(stderr,Usage);
+	exit(1);
+}
+
+/*
+ *			T R A N S F E R
+ *
+ * Time the data movement: source or sink buffers, or copy
+ * stdin to the network or the network to stdout.
+ */
+void
+transfer(void)
+{
+	int n = nbuf;
+
+	nbytes = numCalls = 0;
+	if (statsspec)
+		stats_run(fd);	/* only now, or -E would add the last run twice */
+	if (tstamping)
+		tstamp_start();
+	prep_timer();
+	errno = 0;
+	if (tracefile && trans) {
+		if(udp)  (void)Nwrite( fd, buf, 4 ); /* rcvr start */
+		trace_replay(fd);
+		if(udp)  (void)Nwrite( fd, buf, 4 ); /* rcvr end */
+	} else if (msgmode) {
+		if (trans)
+			msg_source(fd, nbuf);
+		else
+			msg_sink(fd, buf, buflen);
+	} else if (sinkmode) {      
+		register int cnt;
+		if (trans)  {
+		        if (progress || speed)
+			    inittick(progress ? nbuf : 0);
+			pattern( buf, buflen );
+			if(udp)  (void)Nwrite( fd, buf, 4 ); /* rcvr start */
+			if (xdpif) {
+			    xsk_source(n);
+			    n = 0;	/* all sent */
+			} else if (burstspec) {
+			    burst_start();
+			    burst_source(fd, n);
+			    n = 0;
+			}
+			while (n-- && Nwrite(fd,buf,buflen) == buflen) {
+			    if (progress)
+				drawtick(1,buflen);
+			    else if (speed) 
+				dospeed(buflen);
+			    nbytes += buflen;
+			}
+			if(udp)  (void)Nwrite( fd, buf, 4 ); /* rcvr end */
+		        if (progress || speed)
+			    tickdone();
+		} else {
+			if (speed)
+			    inittick(0);
+			if (burstspec)
+			    burst_start();
+			if (ringif) {
+			    pktring_sink();
+			} else if (xdpif) {
+			    xsk_sink();
+			} else if (udp) {
+			    int going = 0;
+			    while ((cnt=Nread(fd,buf,buflen)) > 0)  {
+				    if( cnt <= 4 )  {
+					    /* for -R, ignore the extra end
+					     * markers from the last run */
+					    if( going && (nbytes || repeat == 1) )
+						    break;	/* "EOF" */
+					    going = 1;
+					    prep_timer();
+				    } else {
+					    nbytes += cnt;
+					    if (burstspec)
+						burst_recv(buf, cnt);
+				    }
+				    if (speed)
+					dospeed(cnt);
+			    }
+			} else if (zcrecv) {
+			    zcrecv_sink(fd);
+			} else {
+			    while ((cnt=Nread(fd,buf,buflen)) > 0)  {
+				    nbytes += cnt;
+				    if (burstspec)
+					burst_recv(buf, cnt);
+				    if (speed)
+					dospeed(cnt);
+			    }
+			}
+			if (burstspec)
+			    burst_recv(buf, 0);
+			if (speed)
+			    tickdone();
+		}
+	} else if (mapfile) {
+		if (trans)
+			mapsource(fd);
+		else
+			mapsink(fd);
+	} else if (ringslots) {
+		if (trans)
+			ringsource(fd);
+		else
+			ringsink(fd);
+	} else {
+		register int cnt;
+		if (trans)  {
+			while((cnt=read(0,buf,buflen)) > 0 &&
+			    Nwrite(fd,buf,cnt) == cnt)
+				nbytes += cnt;
+		}  else  {
+			while((cnt=Nread(fd,buf,buflen)) > 0 &&
+			    write(1,buf,cnt) == cnt)
+				nbytes += cnt;
+		}
+	}
+	if(errno) sys_err("IO");
+}
+
+/*
+ *			N E T S E T U P
+ *
+ * Create the socket, apply options, and connect (-t) or accept (-r).
+ */
+void
+netsetup(void)
+{
+	if (!trans && listenfd >= 0) {
+		/* later -R runs reuse the receiving socket */
+		fd = udp ? listenfd : Naccept(listenfd);
+		return;
 	}
 
-	if ((fd = socket(AF_INET, udp?SOCK_DGRAM:SOCK_STREAM, 0)) < 0)
+	if ((fd = socket(domain, udp?SOCK_DGRAM:socktype?socktype:SOCK_STREAM, 0)) < 0)
 		sys_err("socket");
 
 	/* sdo -- Thu May 18, 1995 */
 	/* set LINGER so the close will flush all data */
-	if (!udp) {
-	    static struct linger l;
-
-	    l.l_onoff = 1;      /* linger ON */
-	    l.l_linger = 60*4;  /* 240 seconds, 4 minutes */
-	    if (setsockopt(fd,SOL_SOCKET,SO_LINGER, (char *) &l, sizeof(l)) != 0) {
+	if (!udp && domain == AF_INET) {
+	    if (setlinger(fd) != 0) {
 		perror("setsockopt");
 		exit(-1);
 	    }
@@ -317,9 +963,19 @@ main(
 #if defined(SYSV)
 	if (!trans)  /* bind not really necessary anyway */
 #endif /* defined(SYSV)	 */
-	sinme.sin_family = AF_INET;
-	if (bind(fd, (struct sockaddr *) &sinme, sizeof(sinme)) < 0)
+	if (domain == AF_UNIX) {
+	    /* only the receiver owns the path */
+	    if (!trans) {
+		if (sunme.sun_path[0] != '\0')
+		    (void)unlink(sunme.sun_path);
+		if (bind(fd, (struct sockaddr *) &sunme, sunlen) < 0)
+		    sys_err("bind");
+	    }
+	} else {
+	    sinme.sin_family = AF_INET;
+	    if (bind(fd, (struct sockaddr *) &sinme, sizeof(sinme)) < 0)
 		sys_err("bind");
+	}
 
 #if defined(SO_SNDBUF) || defined(SO_RCVBUF)
 	if (sockbufsize) {
@@ -339,6 +995,14 @@ main(
 	}
 #endif
 
+	if (udp && tstamping)
+	    tstamp_setup(fd);
+	if (udp && !trans && ringif)
+	    pktring_setup();
+	if (xdpif)
+	    xsk_setup();
+	if (udp && !trans && repeat > 1)
+	    listenfd = fd;
 	if (!udp)  {
 	    signal(SIGPIPE, sigpipe);
 	    if (trans) {
@@ -352,7 +1016,7 @@ main(
 				sys_err("setsockopt");
 		}
 #ifdef TCP_NODELAY
-		if (nodelay) {
+		if (nodelay && domain == AF_INET) {
 			struct protoent *p;
 			p = getprotobyname("tcp");
 			if( p && setsockopt(fd, p->p_proto, TCP_NODELAY, 
@@ -361,19 +1025,32 @@ main(
 			if (verbose)
 			    mes("nodelay");
 		}
+#endif
+#ifdef TCP_CONGESTION
+		if (ccname && domain == AF_INET) {
+			if (setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION,
+			    ccname, strlen(ccname)) < 0)
+				sys_err("setsockopt: congestion");
+			if (verbose)
+			    mes(ccname);
+		}
 #endif
 		errno = 0;	
-		if(connect(fd, (struct sockaddr *)&sinhim, sizeof(sinhim)) < 0) {
+		if(connect(fd, peer, peerlen) < 0) {
 		    perror("Connect");
 		    sys_err("connect");
 		}
 		if (verbose)
 		    mes("connect");
+		if (sessiontag || daemonquery)
+		    daemon_hello(fd);
+		if (lowat)
+		    lowat_setup(fd);
 	    } else {
 		/* otherwise, we are the server and 
 	         * should listen for the connections
 	         */
-		listen(fd,1);   /* allow a queue of 0 */
+		listen(fd,sessions == 1 && !daemonhist ? 1 : SOMAXCONN);   /* allow a queue of 0 */
 		/* NB: must be __1__ on tru64 - Mon Aug 13, 2001 -- sdo */
 
 		if(options)  {
@@ -384,95 +1061,40 @@ main(
 #endif
 				sys_err("setsockopt");
 		}
-		{
-		    socklen_t fromlen;
-		    fromlen = sizeof(frominet);
-		    domain = AF_INET;
-		    if((fd=accept(fd, (struct sockaddr *)&frominet, &fromlen)) < 0)
-			sys_err("accept");
-		    { struct sockaddr_in peer;
-			socklen_t peerlen = sizeof(peer);
-			if (getpeername(fd, (struct sockaddr *) &peer, 
-					&peerlen) < 0) {
-			    sys_err("getpeername");
-			}
-			fprintf(stderr,"ttcp-r: accept from %s\n", 
-				inet_ntoa(peer.sin_addr));
-		    }
+#ifdef TCP_CONGESTION
+		if (ccname && domain == AF_INET) {
+			if (setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION,
+			    ccname, strlen(ccname)) < 0)
+				sys_err("setsockopt: congestion");
 		}
-	    }
-	}
-	prep_timer();
-	errno = 0;
-	if (sinkmode) {      
-		register int cnt;
-		if (trans)  {
-		        if (progress)
-			    inittick(nbuf);
-			pattern( buf, buflen );
-			if(udp)  (void)Nwrite( fd, buf, 4 ); /* rcvr start */
-			while (nbuf-- && Nwrite(fd,buf,buflen) == buflen) {
-			    if (progress)
-				drawtick(1,buflen);
-			    else if (speed) 
-				dospeed(buflen);
-			    nbytes += buflen;
-			}
-			if(udp)  (void)Nwrite( fd, buf, 4 ); /* rcvr end */
-		        if (progress)
-			    tickdone();
-			else if (speed)
-			    fprintf(stderr,"\n");
+#endif
+		if (daemonhist) {
+		    daemon_serve(fd);	/* returns in a child with fd set */
+		} else if (sessions != 1) {
+		    serve(fd);		/* returns in a child with fd set */
+		} else if (repeat > 1) {
+		    listenfd = fd;
+		    fd = Naccept(listenfd);
+		} else if (domain == AF_UNIX) {
+		    int lfd = fd;
+
+		    fd = Naccept(lfd);
+		    close(lfd);
 		} else {
-			if (udp) {
-			    while ((cnt=Nread(fd,buf,buflen)) > 0)  {
-				    static int going = 0;
-				    if( cnt <= 4 )  {
-					    if( going )
-						    break;	/* "EOF" */
-					    going = 1;
-					    prep_timer();
-				    } else {
-					    nbytes += cnt;
-				    }
-				    if (speed)
-					dospeed(cnt);
-			    }
-			} else {
-			    while ((cnt=Nread(fd,buf,buflen)) > 0)  {
-				    nbytes += cnt;
-				    if (speed)
-					dospeed(cnt);
-			    }
-			}
-		}
-	} else {
-		register int cnt;
-		if (trans)  {
-			while((cnt=read(0,buf,buflen)) > 0 &&
-			    Nwrite(fd,buf,cnt) == cnt)
-				nbytes += cnt;
-		}  else  {
-			while((cnt=Nread(fd,buf,buflen)) > 0 &&
-			    write(1,buf,cnt) == cnt)
-				nbytes += cnt;
+		    fd = Naccept(fd);
 		}
+	    }
 	}
-	if(errno) sys_err("IO");
+}
 
-	/* sdo -- Thu May 18, 1995 */
-	/* make sure all the data was really delivered */
-	if (!udp)
-	    close(fd);
-	/* end sdo */
-	
-	(void)read_timer(stats,sizeof(stats));
-	if(udp&&trans)  {
-		(void)Nwrite( fd, buf, 4 ); /* rcvr end */
-		(void)Nwrite( fd, buf, 4 ); /* rcvr end */
-		(void)Nwrite( fd, buf, 4 ); /* rcvr end */
-		(void)Nwrite( fd, buf, 4 ); /* rcvr end */
-	}
+/*
+ *			R E P O R T
+ *
+ * Print the results of one run.
+ */
+void
+report(void)
+{
 	if( cput <= 0.0 )  cput = 0.001;
 	if( realt <= 0.0 )  realt = 0.001;
 	fprintf(stdout,
@@ -492,17 +1114,272 @@ main(
 		1024.0 * realt/((double)numCalls),
 		((double)numCalls)/realt);
 	fprintf(stdout,"ttcp%s: %s\n", trans?"-t":"-r", stats);
+	if (lowat && trans)
+	    lowat_report();
+	if (tstamping)
+	    tstamp_report();
+	if (msgmode)
+	    msg_report();
+	if (tracefile)
+	    trace_report();
+	if (mapfile)
+	    mapreport();
+	if (ringslots)
+	    ringreport();
+	if (pmu)
+	    pmu_report();
+	if (syscpu)
+	    syscpu_report();
+	if (ktls)
+	    ktls_report();
+	if (ringif)
+	    pktring_report();
+	if (xdpif)
+	    xsk_report();
+	if (burstspec)
+	    burst_report();
+	if (zcrecv)
+	    zcrecv_report();
 	if (verbose) {
 	    fprintf(stdout,
 		"ttcp%s: buffer address %p\n",
 		trans?"-t":"-r",
 		buf);
 	}
+}
+
+/*
+ *			N A C C E P T
+ *
+ * Accept a connection on lfd and say where it came from.
+ */
+int
+Naccept(int lfd)
+{
+	int fd;
+
+	if (domain == AF_UNIX) {
+	    if ((fd = accept(lfd, (struct sockaddr *)0, (socklen_t *)0)) < 0)
+		sys_err("accept");
+	    fprintf(stderr,"ttcp-r: accept on %s\n", unixpath);
+	} else {
+	    socklen_t fromlen;
+	    fromlen = sizeof(frominet);
+	    if((fd=accept(lfd, (struct sockaddr *)&frominet, &fromlen)) < 0)
+		sys_err("accept");
+	    { struct sockaddr_in peer;
+		socklen_t peerlen = sizeof(peer);
+		if (getpeername(fd, (struct sockaddr *) &peer, 
+				&peerlen) < 0) {
+		    sys_err("getpeername");
+		}
+		fprintf(stderr,"ttcp-r: accept from %s\n", 
+			inet_ntoa(peer.sin_addr));
+	    }
+	}
+	return(fd);
+}
+
+/*
+ *			S E R V E
+ *
+ * Serve -k connections, forking a child for each.  The child returns
+ * with fd set to run the transfer and report as usual; the parent
+ * never returns, it exits once all of its children are done.
+ */
+void
+serve(int lfd)
+{
+	int served;
+	int cfd;
+	pid_t pid;
+
+	fflush(stdout);
+	for (served = 0; sessions == 0 || served < sessions; ++served) {
+	    cfd = Naccept(lfd);
+	    if ((pid = fork()) < 0)
+		sys_err("fork");
+	    if (pid == 0) {
+		close(lfd);
+		fd = cfd;
+		return;
+	    }
+	    close(cfd);
+	    while (waitpid(-1, (int *)0, WNOHANG) > 0)
+		;		/* reap the finished ones */
+	}
+	while (wait((int *)0) > 0)
+	    ;
+	if (domain == AF_UNIX && sunme.sun_path[0] != '\0')
+	    (void)unlink(sunme.sun_path);
 	exit(0);
+}
 
-usage:
-	fprintf(stderr,Usage);
-	exit(1);
+/*
+ *			S E T L I N G E R
+ *
+ * Apply the -L close behavior: linger ON for lingertime seconds
+ * (default 240, 4 minutes), 0 resets the connection on close,
+ * and -1 leaves the system default alone.
+ */
+int
+setlinger(int fd)
+{
+	struct linger l;
+
+	if (lingertime < 0)
+		return(0);
+	l.l_onoff = 1;      /* linger ON */
+	l.l_linger = lingertime;
+	return(setsockopt(fd,SOL_SOCKET,SO_LINGER, (char *) &l, sizeof(l)));
+}
+
+/*
+ *			I P C O P T
+ *
+ * Parse the -U argument: "pipe", "socketpair[:type]" or
+ * "[type:]path" for an AF_UNIX socket, where a leading '@' in
+ * the path selects the Linux abstract namespace.
+ */
+static struct {
+	char *name;
+	int type;
+} socktypes[] = {
+	{ "stream", SOCK_STREAM },
+	{ "seqpacket", SOCK_SEQPACKET },
+	{ "dgram", SOCK_DGRAM },
+	{ NULL, 0 }
+};
+
+static int
+typeprefix(char **pspec)
+{
+	int i, len;
+
+	for (i = 0; socktypes[i].name; ++i) {
+		len = strlen(socktypes[i].name);
+		if (strncmp(*pspec, socktypes[i].name, len) == 0 &&
+		    (*pspec)[len] == ':') {
+			*pspec += len + 1;
+			return(socktypes[i].type);
+		}
+	}
+	return(0);
+}
+
+void
+ipcopt(char *spec)
+{
+	int i;
+
+	if (strcmp(spec, "pipe") == 0) {
+		ipc = IPC_PIPE;
+		return;
+	}
+	if (strncmp(spec, "socketpair", 10) == 0 &&
+	    (spec[10] == '\0' || spec[10] == ':')) {
+		ipc = IPC_PAIR;
+		if (spec[10] == '\0')
+			return;
+		for (i = 0; socktypes[i].name; ++i)
+			if (strcmp(spec + 11, socktypes[i].name) == 0)
+				socktype = socktypes[i].type;
+		if (socktype == 0) {
+			fprintf(stderr, "ttcp: bad socketpair type: %s\n", spec);
+			exit(1);
+		}
+		return;
+	}
+
+	ipc = IPC_UNIX;
+	domain = AF_UNIX;
+	socktype = typeprefix(&spec);
+	unixpath = spec;
+	if (strlen(spec) < 1 || strlen(spec) >= sizeof(sunme.sun_path)) {
+		fprintf(stderr, "ttcp: bad AF_UNIX path: \"%s\"\n", spec);
+		exit(1);
+	}
+	bzero((char *)&sunme, sizeof(sunme));
+	sunme.sun_family = AF_UNIX;
+	strncpy(sunme.sun_path, spec, sizeof(sunme.sun_path) - 1);
+	sunlen = offsetof(struct sockaddr_un, sun_path) + strlen(spec);
+	if (spec[0] == '@')
+		sunme.sun_path[0] = '\0';	/* abstract, length bounds the name */
+	else
+		sunlen++;			/* include the NUL */
+}
+
+/*
+ *			P A I R S E T U P
+ *
+ * Connect ourselves to a forked copy with a pipe or socketpair.
+ * The parent becomes the transmitter and the child the receiver,
+ * both then run the usual loops and print their own reports.
+ */
+void
+pairsetup(void)
+{
+	int fds[2];
+
+	if (ipc == IPC_PIPE) {
+		if (pipe(fds) < 0)
+			sys_err("pipe");
+#ifdef F_SETPIPE_SZ
+		if (sockbufsize &&
+		    fcntl(fds[1], F_SETPIPE_SZ, sockbufsize) < 0)
+			sys_err("fcntl: F_SETPIPE_SZ");
+#endif
+	} else {
+		domain = AF_UNIX;
+		if (socketpair(AF_UNIX, socktype, 0, fds) < 0)
+			sys_err("socketpair");
+		if (sockbufsize) {
+			if (setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF,
+			    (char *)&sockbufsize, sizeof sockbufsize) < 0)
+				sys_err("setsockopt: sndbuf");
+			if (setsockopt(fds[0], SOL_SOCKET, SO_RCVBUF,
+			    (char *)&sockbufsize, sizeof sockbufsize) < 0)
+				sys_err("setsockopt: rcvbuf");
+		}
+		peer = (struct sockaddr *)0;	/* already connected */
+		peerlen = 0;
+	}
+	signal(SIGPIPE, sigpipe);
+	fflush(stdout);
+	if ((child = fork()) < 0)
+		sys_err("fork");
+	if (child == 0) {
+		trans = 0;
+		fd = fds[0];
+		close(fds[1]);
+	} else {
+		trans = 1;
+		fd = fds[1];
+		close(fds[0]);
+	}
+}
+
+/*
+ *			T R A N S P O R T
+ *
+ * Name of the transport in use, for the reports.
+ */
+char *
+transport(void)
+{
+	static char name[32];
+	int i;
+
+	if (ipc == IPC_NONE)
+		return(udp?"udp":"tcp");
+	if (ipc == IPC_PIPE)
+		return("pipe");
+	for (i = 0; socktypes[i].name; ++i)
+		if (socktypes[i].type == socktype)
+			break;
+	sprintf(name, "%s-%s", ipc == IPC_PAIR ? "socketpair" : "unix",
+	    socktypes[i].name ? socktypes[i].name : "stream");
+	return(name);
 }
 
 void
@@ -531,6 +1408,22 @@ pattern(register char *cp, register int cnt)
 	}
 }
 
+/*
+ * -T: read every byte that came in.  The sum has to land somewhere
+ * the compiler can see, or it drops the loop and -T does nothing.
+ */
+unsigned long touchsum;
+
+void
+touch(register char *b, register int c)
+{
+	register int sum = 0;
+
+	while (c--)
+		sum += *b++;
+	touchsum += sum;
+}
+
 char *
 outfmt(double b)
 {
@@ -604,6 +1497,10 @@ prep_timer(void)
 {
 	gettimeofday(&time0, (struct timezone *)0);
 	getrusage(RUSAGE_SELF, &ru0);
+	if (pmu)
+		pmu_start();
+	if (syscpu)
+		syscpu_start();
 }
 
 /*
@@ -619,6 +1516,10 @@ read_timer(char *str, int len)
 	struct timeval tend, tstart;
 	char line[132];
 
+	if (pmu)
+		pmu_stop();
+	if (syscpu)
+		syscpu_stop();
 	getrusage(RUSAGE_SELF, &ru1);
 	gettimeofday(&timedol, (struct timezone *)0);
 	prusage(&ru0, &ru1, &timedol, &time0, line);
@@ -799,10 +1700,12 @@ psecs(long int l, register char *cp)
 int
 Nread(int fd, void *buf, int count)
 {
-	struct sockaddr_in from;
+	struct sockaddr_storage from;
 	socklen_t len = sizeof(from);
 	register int cnt;
-	if( udp )  {
+	if( udp && tstamping )  {
+		cnt = tstamp_recv( fd, buf, count );
+	} else if( udp )  {
 		cnt = recvfrom( fd, buf, count, 0,(struct sockaddr *)&from,
 			       &len );
 		numCalls++;
@@ -813,13 +1716,11 @@ Nread(int fd, void *buf, int count)
 			cnt = read( fd, buf, count );
 			numCalls++;
 		}
-		if (touchdata && cnt > 0) {
-			register int c = cnt, sum = 0;
-			register char *b = buf;
-			while (c--)
-				sum += *b++;
-		}
+		if (touchdata && cnt > 0)
+			touch(buf, cnt);
 	}
+	if (tracefile && cnt > (udp ? 4 : 0))
+		trace_record(cnt);
 	return(cnt);
 }
 
@@ -832,14 +1733,19 @@ Nwrite(int fd, void *buf, int count)
 	register int cnt;
 	if( udp )  {
 again:
-		cnt = sendto( fd, buf, count, 0, (struct sockaddr *) &sinhim,
-			     sizeof(sinhim) );
-		numCalls++;
+		if (tstamping)
+			cnt = tstamp_send( fd, buf, count );
+		else {
+			cnt = sendto( fd, buf, count, 0, peer, peerlen );
+			numCalls++;
+		}
 		if( cnt<0 && errno == ENOBUFS )  {
 			delay(18000);
 			errno = 0;
 			goto again;
 		}
+	} else if (lowat) {
+		cnt = lowat_write( fd, buf, count );
 	} else {
 		cnt = write( fd, buf, count );
 		numCalls++;
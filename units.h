@@ -0,0 +1,2 @@
+/* what "per GB" means in every report */
+#define GIGABYTE (1024.0*1024.0*1024.0)
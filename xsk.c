@@ -0,0 +1,641 @@
+/*
+ * xsk.c - move the UDP test flow through an AF_XDP socket (-x)
+ *
+ * A kernel bypass path to compare with the socket one.  Both ends
+ * register a UMEM, an area of fixed size frames shared with the
+ * kernel, and talk to it through four single producer rings: fill
+ * (frames we give the kernel to receive into), RX, TX, and completion
+ * (frames the kernel has finished sending).  The receiver loads a tiny
+ * XDP program that redirects UDP to our port into the socket and
+ * passes everything else; the sender builds the Ethernet, IP and UDP
+ * headers itself, once, into every frame.
+ *
+ * Zero-copy needs driver support; without it we fall back to the
+ * driver's copy mode, and without XDP in the driver at all to generic
+ * (skb) mode, which works on anything including lo and veth.  Only
+ * the one queue is served, so on a multiqueue NIC the flow has to be
+ * steered there (ethtool -N, or -L combined 1).  The sentinels still
+ * go through the ordinary socket on the sending side, and are picked
+ * out of the frames on the receiving side.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#ifdef __linux__
+#include <linux/if_xdp.h>
+#include <linux/if_link.h>
+#include <linux/bpf.h>
+#endif
+#include "xsk.h"
+
+extern int fd;
+extern int trans;
+extern short port;
+extern int buflen;
+extern char *buf;
+extern char *xdpif;		/* interface[:queue][,mode] */
+extern struct sockaddr_in sinhim;
+extern unsigned long nbytes;
+extern unsigned long numCalls;
+extern double realt;
+
+void sys_err(char *s);
+void prep_timer(void);
+
+#if defined(XDP_USE_NEED_WAKEUP) && defined(XDP_FLAGS_REPLACE)	/* and bpf links */
+
+#define NFRAMES	  4096
+#define FRAMESIZE 4096		/* UMEM chunk, a page */
+#define NDESC	  2048		/* each ring */
+#define HDRLEN	  42		/* ether + ip + udp */
+
+struct xring {
+    unsigned *prod;
+    unsigned *cons;
+    unsigned *flags;
+    void *desc;
+    void *map;
+    size_t maplen;
+};
+
+static int xfd = -1;
+static int linkfd = -1;
+static char *umem;
+static struct xring rx, tx, fr, cr;
+static char ifname[IF_NAMESIZE];
+static int ifindex;
+static unsigned queue;
+static char *modename;
+static int zerocopy;
+static unsigned long datagrams;
+static unsigned long kicks;	/* sendto()s and poll()s */
+static struct xdp_statistics xst;
+
+#define M_ZC	1
+#define M_DRV	2
+#define M_SKB	4
+
+static int
+bpf(int cmd, union bpf_attr *attr)
+{
+    return(syscall(__NR_bpf, cmd, attr, sizeof(*attr)));
+}
+
+static struct bpf_insn
+insn(int code, int dst, int src, int off, int imm)
+{
+    struct bpf_insn i;
+
+    memset(&i, 0, sizeof(i));
+    i.code = code;
+    i.dst_reg = dst;
+    i.src_reg = src;
+    i.off = off;
+    i.imm = imm;
+    return(i);
+}
+
+/* IPv4/UDP to our port on this queue goes to the socket, the rest on up */
+static int
+loadprog(int mapfd)
+{
+    struct bpf_insn p[22];
+    union bpf_attr attr;
+    char log[4096];
+    int n = 0, pfd;
+
+#define PASS(at) (20 - ((at) + 1))
+    p[n++] = insn(BPF_ALU64|BPF_MOV|BPF_X, 6, 1, 0, 0);	/* r6 = ctx */
+    p[n++] = insn(BPF_LDX|BPF_MEM|BPF_W, 2, 6, 0, 0);	/* r2 = data */
+    p[n++] = insn(BPF_LDX|BPF_MEM|BPF_W, 3, 6, 4, 0);	/* r3 = data_end */
+    p[n++] = insn(BPF_ALU64|BPF_MOV|BPF_X, 4, 2, 0, 0);
+    p[n++] = insn(BPF_ALU64|BPF_ADD|BPF_K, 4, 0, 0, HDRLEN);
+    p[n++] = insn(BPF_JMP|BPF_JGT|BPF_X, 4, 3, PASS(5), 0);
+    p[n++] = insn(BPF_LDX|BPF_MEM|BPF_H, 5, 2, 12, 0);	/* ethertype */
+    p[n++] = insn(BPF_JMP|BPF_JNE|BPF_K, 5, 0, PASS(7), htons(0x0800));
+    p[n++] = insn(BPF_LDX|BPF_MEM|BPF_B, 5, 2, 23, 0);	/* ip proto */
+    p[n++] = insn(BPF_JMP|BPF_JNE|BPF_K, 5, 0, PASS(9), IPPROTO_UDP);
+    p[n++] = insn(BPF_LDX|BPF_MEM|BPF_B, 5, 2, 14, 0);	/* no ip options */
+    p[n++] = insn(BPF_JMP|BPF_JNE|BPF_K, 5, 0, PASS(11), 0x45);
+    p[n++] = insn(BPF_LDX|BPF_MEM|BPF_H, 5, 2, 36, 0);	/* udp dst port */
+    p[n++] = insn(BPF_JMP|BPF_JNE|BPF_K, 5, 0, PASS(13), htons(port));
+    p[n++] = insn(BPF_LDX|BPF_MEM|BPF_W, 2, 6, 16, 0);	/* rx_queue_index */
+    p[n++] = insn(BPF_LD|BPF_DW|BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, mapfd);
+    p[n++] = insn(0, 0, 0, 0, 0);
+    p[n++] = insn(BPF_ALU64|BPF_MOV|BPF_K, 3, 0, 0, XDP_PASS);	/* if no socket */
+    p[n++] = insn(BPF_JMP|BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map);
+    p[n++] = insn(BPF_JMP|BPF_EXIT, 0, 0, 0, 0);
+    p[n++] = insn(BPF_ALU64|BPF_MOV|BPF_K, 0, 0, 0, XDP_PASS);	/* 20 */
+    p[n++] = insn(BPF_JMP|BPF_EXIT, 0, 0, 0, 0);
+#undef PASS
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.expected_attach_type = BPF_XDP;
+    attr.insns = (unsigned long)p;
+    attr.insn_cnt = n;
+    attr.license = (unsigned long)"GPL";
+    attr.log_buf = (unsigned long)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+    log[0] = '\0';
+    if ((pfd = bpf(BPF_PROG_LOAD, &attr)) < 0) {
+	if (log[0])
+	    fprintf(stderr, "%s", log);
+	sys_err("bpf: BPF_PROG_LOAD");
+    }
+    return(pfd);
+}
+
+static void
+mapring(
+    struct xring *r,
+    struct xdp_ring_offset *off,
+    size_t descsize,
+    off_t pgoff)
+{
+    r->maplen = off->desc + NDESC * descsize;
+    r->map = mmap(NULL, r->maplen, PROT_READ|PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, xfd, pgoff);
+    if (r->map == MAP_FAILED)
+	sys_err("mmap: AF_XDP ring");
+    r->prod = (unsigned *)((char *)r->map + off->producer);
+    r->cons = (unsigned *)((char *)r->map + off->consumer);
+    r->flags = (unsigned *)((char *)r->map + off->flags);
+    r->desc = (char *)r->map + off->desc;
+}
+
+static void
+unmapring(struct xring *r)
+{
+    if (r->map)
+	(void)munmap(r->map, r->maplen);
+    memset(r, 0, sizeof(*r));
+}
+
+/* socket, umem and rings, bound with these flags; -1 if the bind fails */
+static int
+xsk_open(int flags)
+{
+    struct xdp_umem_reg mr;
+    struct xdp_mmap_offsets off;
+    struct sockaddr_xdp sxdp;
+    socklen_t optlen;
+    int n = NDESC;
+    int err;
+
+    if ((xfd = socket(AF_XDP, SOCK_RAW, 0)) < 0)
+	sys_err("socket: AF_XDP");
+    memset(&mr, 0, sizeof(mr));
+    mr.addr = (unsigned long)umem;
+    mr.len = (unsigned long)NFRAMES * FRAMESIZE;
+    mr.chunk_size = FRAMESIZE;
+    if (setsockopt(xfd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr)) < 0)
+	sys_err("setsockopt: XDP_UMEM_REG");
+    if (setsockopt(xfd, SOL_XDP, XDP_UMEM_FILL_RING, &n, sizeof(n)) < 0 ||
+	setsockopt(xfd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &n, sizeof(n)) < 0)
+	sys_err("setsockopt: XDP fill/completion ring");
+    if (setsockopt(xfd, SOL_XDP, trans ? XDP_TX_RING : XDP_RX_RING,
+		   &n, sizeof(n)) < 0)
+	sys_err("setsockopt: XDP rx/tx ring");
+    optlen = sizeof(off);
+    if (getsockopt(xfd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0)
+	sys_err("getsockopt: XDP_MMAP_OFFSETS");
+    mapring(&fr, &off.fr, sizeof(__u64), XDP_UMEM_PGOFF_FILL_RING);
+    mapring(&cr, &off.cr, sizeof(__u64), XDP_UMEM_PGOFF_COMPLETION_RING);
+    if (trans)
+	mapring(&tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING);
+    else
+	mapring(&rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING);
+
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP |
+	((flags & M_ZC) ? XDP_ZEROCOPY : XDP_COPY);
+    sxdp.sxdp_ifindex = ifindex;
+    sxdp.sxdp_queue_id = queue;
+    if (bind(xfd, (struct sockaddr *)&sxdp, sizeof(sxdp)) == 0)
+	return(0);
+
+    err = errno;
+    unmapring(&fr);
+    unmapring(&cr);
+    unmapring(&tx);
+    unmapring(&rx);
+    (void)close(xfd);
+    xfd = -1;
+    errno = err;
+    return(-1);
+}
+
+/* the XDP program onto the interface in driver or generic mode */
+static int
+attach(int progfd, int flags)
+{
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = progfd;
+    attr.link_create.target_ifindex = ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = (flags & M_SKB) ? XDP_FLAGS_SKB_MODE
+					     : XDP_FLAGS_DRV_MODE;
+    return(linkfd = bpf(BPF_LINK_CREATE, &attr));
+}
+
+
+void
+xsk_setup(void)
+{
+    static const int order[] = { M_DRV|M_ZC, M_DRV, M_SKB };
+    union bpf_attr attr;
+    struct rlimit rl = { RLIM_INFINITY, RLIM_INFINITY };
+    char *p;
+    int want = M_DRV|M_ZC|M_SKB;
+    int mapfd = -1, progfd = -1;
+    int attached = 0;
+    int i, key;
+
+    if (trans && buflen + HDRLEN > FRAMESIZE) {
+	fprintf(stderr, "ttcp: -x: -l can be at most %d\n", FRAMESIZE - HDRLEN);
+	exit(1);
+    }
+    snprintf(ifname, sizeof(ifname), "%.*s", (int)strcspn(xdpif, ":,"), xdpif);
+    if ((p = strchr(xdpif, ':')) != NULL)
+	queue = atoi(p + 1);
+    if ((p = strchr(xdpif, ',')) != NULL) {
+	if (strcmp(p + 1, "zc") == 0)
+	    want = M_DRV|M_ZC;
+	else if (strcmp(p + 1, "copy") == 0)
+	    want = M_DRV;
+	else if (strcmp(p + 1, "skb") == 0)
+	    want = M_SKB;
+	else {
+	    fprintf(stderr, "ttcp: -x: mode is zc, copy or skb\n");
+	    exit(1);
+	}
+    }
+    if ((ifindex = if_nametoindex(ifname)) == 0)
+	sys_err(ifname);
+
+    /* the UMEM is pinned and counted against RLIMIT_MEMLOCK */
+    (void)setrlimit(RLIMIT_MEMLOCK, &rl);
+    umem = mmap(NULL, (size_t)NFRAMES * FRAMESIZE, PROT_READ|PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (umem == MAP_FAILED)
+	sys_err("mmap: UMEM");
+
+    if (!trans) {
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = BPF_MAP_TYPE_XSKMAP;
+	attr.key_size = sizeof(int);
+	attr.value_size = sizeof(int);
+	attr.max_entries = queue + 1;
+	if ((mapfd = bpf(BPF_MAP_CREATE, &attr)) < 0)
+	    sys_err("bpf: BPF_MAP_CREATE");
+	progfd = loadprog(mapfd);
+    }
+
+    /* best first; a sender needs no program, only the bind */
+    for (i = 0; i < 3; ++i) {
+	if ((order[i] & want) != order[i])
+	    continue;
+	if (!trans && (linkfd < 0 || (attached & M_SKB) != (order[i] & M_SKB))) {
+	    if (linkfd >= 0)
+		(void)close(linkfd);
+	    if (attach(progfd, order[i]) < 0)
+		continue;
+	    attached = order[i];
+	}
+	if (xsk_open(order[i]) == 0)
+	    break;
+    }
+    if (xfd < 0)
+	sys_err(trans ? "bind: AF_XDP" : "AF_XDP: no XDP mode worked");
+    if (order[i] & M_ZC)
+	modename = "zero-copy";
+    else if (trans)
+	modename = "copy";
+    else if (order[i] & M_DRV)
+	modename = "driver mode, copy";
+    else
+	modename = "generic (skb) mode";
+
+#ifdef XDP_OPTIONS_ZEROCOPY
+    {
+	struct xdp_options opt;
+	socklen_t optlen = sizeof(opt);
+
+	if (getsockopt(xfd, SOL_XDP, XDP_OPTIONS, &opt, &optlen) == 0)
+	    zerocopy = (opt.flags & XDP_OPTIONS_ZEROCOPY) != 0;
+    }
+#endif
+
+    if (!trans) {
+	key = queue;
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = mapfd;
+	attr.key = (unsigned long)&key;
+	attr.value = (unsigned long)&xfd;
+	if (bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+	    sys_err("bpf: BPF_MAP_UPDATE_ELEM");
+	(void)close(progfd);	/* the link and the map hold them now */
+	(void)close(mapfd);
+    }
+}
+
+#define LOAD(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+
+void
+xsk_sink(void)
+{
+    struct xdp_desc *d;
+    struct pollfd pfds;
+    socklen_t optlen;
+    unsigned char *ip;
+    __u64 *fill = fr.desc;
+    unsigned rcons, rprod, fprod;
+    int going = 0, done = 0;
+    int ihl, len;
+
+    /* every frame we'll use starts out with the kernel */
+    fprod = *fr.prod;
+    for (rcons = 0; rcons < NDESC; ++rcons)
+	fill[fprod++ & (NDESC - 1)] = (__u64)rcons * FRAMESIZE;
+    STORE(fr.prod, fprod);
+
+    rcons = *rx.cons;
+    while (!done) {
+	if ((rprod = LOAD(rx.prod)) == rcons) {
+	    pfds.fd = xfd;
+	    pfds.events = POLLIN;
+	    pfds.revents = 0;
+	    ++kicks;
+	    if (poll(&pfds, 1, -1) < 0 && errno != EINTR)
+		sys_err("poll");
+	    continue;
+	}
+	for (; rcons != rprod; ++rcons) {
+	    d = (struct xdp_desc *)rx.desc + (rcons & (NDESC - 1));
+	    ip = (unsigned char *)umem + d->addr + 14;
+	    ihl = (ip[0] & 0xf) * 4;
+	    len = ((ip[ihl + 4] << 8) | ip[ihl + 5]) - 8;	/* udp length */
+	    fill[fprod++ & (NDESC - 1)] = d->addr & ~(__u64)(FRAMESIZE - 1);
+
+	    if (done)
+		continue;
+	    if (len <= 4) {
+		/* the same sentinels the socket receiver looks for */
+		if (going && nbytes)
+		    done = 1;
+		else if (!going) {
+		    going = 1;
+		    prep_timer();
+		}
+	    } else if (going) {
+		++datagrams;
+		++numCalls;
+		nbytes += len;
+	    }
+	}
+	STORE(rx.cons, rcons);
+	STORE(fr.prod, fprod);
+    }
+
+    optlen = sizeof(xst);
+    (void)getsockopt(xfd, SOL_XDP, XDP_STATISTICS, &xst, &optlen);
+}
+
+
+/* hardware address of the next hop toward him, from the ARP cache */
+static int
+nexthop(unsigned char *mac)
+{
+    unsigned long dst, gw, mask, best = 0;
+    unsigned flags, m[6];
+    unsigned long via = sinhim.sin_addr.s_addr;
+    char line[256], dev[64], ipstr[64];
+    struct in_addr a;
+    FILE *f;
+    int i, found = 0;
+
+    if ((f = fopen("/proc/net/route", "r")) != NULL) {
+	while (fgets(line, sizeof(line), f)) {
+	    if (sscanf(line, "%63s %lx %lx %x %*d %*d %*d %lx",
+		       dev, &dst, &gw, &flags, &mask) != 5)
+		continue;
+	    if (strcmp(dev, ifname) != 0 ||
+		(sinhim.sin_addr.s_addr & mask) != dst)
+		continue;
+	    if (!found || ntohl(mask) >= ntohl(best)) {
+		best = mask;
+		via = gw ? gw : sinhim.sin_addr.s_addr;
+		found = 1;
+	    }
+	}
+	fclose(f);
+    }
+    a.s_addr = via;
+
+    /* the start sentinel went through the socket, so ARP is under way */
+    for (i = 0; i < 100; ++i) {
+	if ((f = fopen("/proc/net/arp", "r")) == NULL)
+	    return(-1);
+	while (fgets(line, sizeof(line), f)) {
+	    if (sscanf(line, "%63s %*s %x %x:%x:%x:%x:%x:%x %*s %63s", ipstr,
+		       &flags, &m[0], &m[1], &m[2], &m[3], &m[4], &m[5],
+		       dev) != 9)
+		continue;
+	    if (strcmp(ipstr, inet_ntoa(a)) == 0 &&
+		strcmp(dev, ifname) == 0 && (flags & 0x2)) {
+		fclose(f);
+		for (i = 0; i < 6; ++i)
+		    mac[i] = m[i];
+		return(0);
+	    }
+	}
+	fclose(f);
+	usleep(10000);
+    }
+    return(-1);
+}
+
+static unsigned short
+ipsum(unsigned char *p, int len)
+{
+    unsigned long sum = 0;
+
+    for (; len > 1; p += 2, len -= 2)
+	sum += (p[0] << 8) | p[1];
+    while (sum >> 16)
+	sum = (sum & 0xffff) + (sum >> 16);
+    return(~sum & 0xffff);
+}
+
+/* Ethernet, IPv4 and UDP headers and the pattern, as sent */
+static int
+buildframe(unsigned char *f)
+{
+    struct sockaddr_in me, src;
+    struct ifreq ifr;
+    socklen_t len;
+    unsigned char *ip = f + 14, *udp = f + 34;
+    unsigned short sum;
+    int s, loop;
+
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+    if (ioctl(fd, SIOCGIFFLAGS, &ifr) < 0)
+	sys_err("ioctl: SIOCGIFFLAGS");
+    loop = (ifr.ifr_flags & IFF_LOOPBACK) != 0;
+    if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0)
+	sys_err("ioctl: SIOCGIFHWADDR");
+    memcpy(f + 6, ifr.ifr_hwaddr.sa_data, 6);
+    if (loop)
+	memset(f, 0, 6);
+    else if (nexthop(f) < 0) {
+	fprintf(stderr, "ttcp: -x: no ARP entry for the next hop on %s\n",
+		ifname);
+	exit(1);
+    }
+    f[12] = 0x08;
+    f[13] = 0x00;
+
+    /* the source address the kernel would pick, and our socket's port */
+    if ((s = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+	sys_err("socket");
+    len = sizeof(src);
+    if (connect(s, (struct sockaddr *)&sinhim, sizeof(sinhim)) < 0 ||
+	getsockname(s, (struct sockaddr *)&src, &len) < 0)
+	sys_err("source address");
+    (void)close(s);
+    len = sizeof(me);
+    if (getsockname(fd, (struct sockaddr *)&me, &len) < 0)
+	sys_err("getsockname");
+
+    ip[0] = 0x45;
+    ip[1] = 0;
+    ip[2] = (20 + 8 + buflen) >> 8;
+    ip[3] = (20 + 8 + buflen) & 0xff;
+    ip[4] = ip[5] = 0;			/* id */
+    ip[6] = 0x40;			/* DF */
+    ip[7] = 0;
+    ip[8] = 64;				/* ttl */
+    ip[9] = IPPROTO_UDP;
+    ip[10] = ip[11] = 0;
+    memcpy(ip + 12, &src.sin_addr, 4);
+    memcpy(ip + 16, &sinhim.sin_addr, 4);
+    sum = ipsum(ip, 20);
+    ip[10] = sum >> 8;
+    ip[11] = sum & 0xff;
+
+    memcpy(udp, &me.sin_port, 2);
+    memcpy(udp + 2, &sinhim.sin_port, 2);
+    udp[4] = (8 + buflen) >> 8;
+    udp[5] = (8 + buflen) & 0xff;
+    udp[6] = udp[7] = 0;		/* no checksum, fine for IPv4 */
+    memcpy(udp + 8, buf, buflen);
+    return(HDRLEN + buflen);
+}
+
+
+void
+xsk_source(int n)
+{
+    struct xdp_desc *d;
+    socklen_t optlen;
+    unsigned tprod, ccons, cprod;
+    unsigned long sent = 0, done = 0, room;
+    int i, flen;
+
+    /* every frame is the same, so they're built once */
+    flen = buildframe((unsigned char *)umem);
+    for (i = 1; i < NDESC; ++i)
+	memcpy(umem + (size_t)i * FRAMESIZE, umem, flen);
+
+    tprod = *tx.prod;
+    ccons = *cr.cons;
+    while (done < (unsigned long)n) {
+	if ((cprod = LOAD(cr.prod)) != ccons) {
+	    done += cprod - ccons;
+	    ccons = cprod;
+	    STORE(cr.cons, ccons);
+	}
+	room = NDESC - (sent - done);
+	if (room > n - sent)
+	    room = n - sent;
+	for (; room; --room, ++sent) {
+	    d = (struct xdp_desc *)tx.desc + (tprod++ & (NDESC - 1));
+	    d->addr = (sent % NDESC) * FRAMESIZE;
+	    d->len = flen;
+	    d->options = 0;
+	}
+	STORE(tx.prod, tprod);
+	if (sent != done && (LOAD(tx.flags) & XDP_RING_NEED_WAKEUP)) {
+	    ++kicks;
+	    if (sendto(xfd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+		errno != EAGAIN && errno != EBUSY && errno != ENOBUFS &&
+		errno != EINTR)
+		sys_err("sendto: AF_XDP");
+	}
+    }
+    datagrams = sent;
+    numCalls += sent;
+    nbytes += sent * buflen;
+    errno = 0;			/* the EAGAINs above were expected */
+
+    optlen = sizeof(xst);
+    (void)getsockopt(xfd, SOL_XDP, XDP_STATISTICS, &xst, &optlen);
+}
+
+
+void
+xsk_report(void)
+{
+    char *t = trans ? "-t" : "-r";
+
+    fprintf(stdout,
+	    "ttcp%s: AF_XDP on %s queue %u, %s: %lu datagrams (%.0f/sec), %lu wakeups\n",
+	    t, ifname, queue, zerocopy ? "zero-copy" : modename,
+	    datagrams, realt > 0.0 ? datagrams / realt : 0.0, kicks);
+    if (trans)
+	fprintf(stdout, "ttcp-t: xsk tx: %llu invalid descs, %llu ring empty\n",
+		(unsigned long long)xst.tx_invalid_descs,
+		(unsigned long long)xst.tx_ring_empty_descs);
+    else
+	fprintf(stdout,
+		"ttcp-r: xsk drops: %llu (%llu with the fill ring empty), %llu rx ring full\n",
+		(unsigned long long)(xst.rx_dropped + xst.rx_invalid_descs),
+		(unsigned long long)xst.rx_fill_ring_empty_descs,
+		(unsigned long long)xst.rx_ring_full);
+}
+
+#else /* no AF_XDP */
+
+void
+xsk_setup(void)
+{
+    fprintf(stderr, "ttcp: -x: AF_XDP isn't supported here\n");
+    exit(1);
+}
+
+void xsk_sink(void) {}
+void xsk_source(int n) {}
+void xsk_report(void) {}
+
+#endif
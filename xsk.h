@@ -0,0 +1,4 @@
+void xsk_setup(void);
+void xsk_sink(void);
+void xsk_source(int n);
+void xsk_report(void);
@@ -0,0 +1,197 @@
+/*
+ * zcrecv.c - TCP receive without the copy (-z)
+ *
+ * For -r -s the data are thrown away, so copying them out of the
+ * socket is pure overhead.  With TCP_ZEROCOPY_RECEIVE the kernel maps
+ * whole received pages into a window we've mmap()ed on the socket,
+ * replacing whatever the last call put there.  Only page aligned,
+ * page sized runs of payload can be mapped; the kernel says how much
+ * that follows can't be (recv_skip_hint), and we read() that into buf
+ * as usual.  Newer kernels also copy short runs straight into buf for
+ * us (copybuf).  Mapped and copied bytes are counted separately.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#ifdef __linux__
+#include <linux/tcp.h>
+#endif
+#include "zcrecv.h"
+
+extern int buflen;
+extern char *buf;
+extern int touchdata;
+extern int speed;
+extern char *burstspec;
+extern unsigned long nbytes;
+extern unsigned long numCalls;
+
+void sys_err(char *s);
+void touch(register char *b, register int c);
+void dospeed(int nbytes);
+void burst_recv(char *rbuf, int cnt);
+
+#define WINDOW	(8 * 1024 * 1024)	/* mapped at once, at most */
+
+static unsigned long mapped;	/* bytes that came in as pages */
+static unsigned long copied;	/*  and that were copied */
+static unsigned long zcalls;	/* getsockopt()s */
+static unsigned long reads;	/* read()s for what couldn't be mapped */
+static char *why;		/* if it had to copy everything */
+
+
+/* n bytes arrived at p */
+static void
+got(char *p, int n)
+{
+    nbytes += n;
+    if (touchdata)
+	touch(p, n);
+    if (burstspec)
+	burst_recv(p, n);
+    if (speed)
+	dospeed(n);
+}
+
+/* copy up to n bytes the old way; 0 at EOF */
+static int
+copyin(int fd, int n)
+{
+    int cnt;
+
+    if (n > buflen)
+	n = buflen;
+    if ((cnt = read(fd, buf, n)) < 0)
+	sys_err("read");
+    ++reads;
+    ++numCalls;
+    copied += cnt;
+    got(buf, cnt);
+    return(cnt);
+}
+
+
+#ifdef TCP_ZEROCOPY_RECEIVE
+
+void
+zcrecv_sink(int fd)
+{
+    struct tcp_zerocopy_receive zc;
+    struct pollfd pfd;
+    socklen_t zclen;
+    char *win;
+    int idle = 0;
+
+    mapped = copied = zcalls = reads = 0;
+    why = NULL;
+    win = mmap(NULL, WINDOW, PROT_READ, MAP_SHARED, fd, 0);
+    if (win == MAP_FAILED) {
+	why = "mmap() of the socket failed";
+	while (copyin(fd, buflen) > 0)
+	    ;
+	return;
+    }
+
+    for (;;) {
+	memset(&zc, 0, sizeof(zc));
+	zc.address = (unsigned long)win;
+	zc.length = WINDOW;
+	zc.copybuf_address = (unsigned long)buf;
+	zc.copybuf_len = buflen;
+#ifdef TCP_RECEIVE_ZEROCOPY_FLAG_TLB_CLEAN_HINT
+	zc.flags = TCP_RECEIVE_ZEROCOPY_FLAG_TLB_CLEAN_HINT;
+#endif
+	zclen = sizeof(zc);
+	++zcalls;
+	++numCalls;
+	if (getsockopt(fd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE, &zc, &zclen) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EIO)
+		break;		/* nothing left and the peer's done */
+	    if (zcalls > 1 || (errno != EINVAL && errno != EOPNOTSUPP))
+		sys_err("getsockopt: TCP_ZEROCOPY_RECEIVE");
+	    why = "the kernel won't map this socket";
+	    while (copyin(fd, buflen) > 0)
+		;
+	    break;
+	}
+	if (zc.err) {
+	    errno = -zc.err;
+	    sys_err("TCP_ZEROCOPY_RECEIVE");
+	}
+
+	if (zc.length) {
+	    mapped += zc.length;
+	    got(win, zc.length);
+	}
+	if (zclen > offsetof(struct tcp_zerocopy_receive, copybuf_len) &&
+	    zc.copybuf_len > 0) {
+	    copied += zc.copybuf_len;
+	    got(buf, zc.copybuf_len);
+	}
+	if (zc.recv_skip_hint) {
+	    /* the unaligned bit after what was mapped */
+	    if (copyin(fd, zc.recv_skip_hint) == 0)
+		break;
+	    idle = 0;
+	    continue;
+	}
+	if (zc.length || (zclen > offsetof(struct tcp_zerocopy_receive,
+	    copybuf_len) && zc.copybuf_len > 0)) {
+	    idle = 0;
+	    continue;
+	}
+
+	/* nothing there: wait, then let a read() notice EOF */
+	if (!idle) {
+	    pfd.fd = fd;
+	    pfd.events = POLLIN;
+	    if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+		sys_err("poll");
+	    idle = 1;
+	    continue;
+	}
+	if (copyin(fd, buflen) == 0)
+	    break;
+	idle = 0;
+    }
+    (void)munmap(win, WINDOW);
+    errno = 0;
+}
+
+#else /* no TCP_ZEROCOPY_RECEIVE */
+
+void
+zcrecv_sink(int fd)
+{
+    mapped = copied = zcalls = reads = 0;
+    why = "TCP_ZEROCOPY_RECEIVE isn't supported here";
+    while (copyin(fd, buflen) > 0)
+	;
+}
+
+#endif
+
+
+void
+zcrecv_report(void)
+{
+    unsigned long total = mapped + copied;
+
+    fprintf(stdout,
+	    "ttcp-r: zero-copy receive: %lu bytes mapped (%.1f%%), %lu copied, in %lu getsockopt()s and %lu read()s\n",
+	    mapped, total ? 100.0 * mapped / total : 0.0, copied, zcalls, reads);
+    if (why)
+	fprintf(stdout, "ttcp-r: zero-copy receive: copied everything, %s\n",
+		why);
+}
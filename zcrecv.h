@@ -0,0 +1,2 @@
+void zcrecv_sink(int fd);
+void zcrecv_report(void);